@@ -9,9 +9,9 @@ BarabasiAlbert::BarabasiAlbert(GraphScene *graph):
     ctlW(0),
     barabasiCtl(0),
     size(START_NODES),
-    nodeDegree(START_DEGREE)
+    nodeDegree(START_DEGREE),
+    exponent(START_EXPONENT)
 {
-    updatePreference(graph->nodes(), 2 * graph->edges().size());
 }
 
 BarabasiAlbert::~BarabasiAlbert() {
@@ -29,9 +29,12 @@ int BarabasiAlbert::getNodeDegree() const {
     return nodeDegree;
 }
 
+double BarabasiAlbert::getExponent() const {
+    return exponent;
+}
+
 void BarabasiAlbert::reset() {
-    preferences.clear();
-    cumulativePreferences.clear();
+    endpoints.clear();
     for (int i(0); i < size; ++i) {
         addVertex(false);
     }
@@ -48,6 +51,7 @@ QWidget* BarabasiAlbert::controlWidget(QWidget *parent) {
 
         connect(barabasiCtl->sizeEdit, SIGNAL(valueChanged(int)), this, SLOT(onSizeChanged(int)));
         connect(barabasiCtl->degreeEdit, SIGNAL(valueChanged(int)), this, SLOT(onDegreeChanged(int)));
+        connect(barabasiCtl->exponentEdit, SIGNAL(valueChanged(double)), this, SLOT(onExponentChanged(double)));
     }
     return ctlW;
 }
@@ -70,11 +74,8 @@ void BarabasiAlbert::addVertex(bool saveSize) {
 
 // Add vertex using preferential attachment without clustering.
 void BarabasiAlbert::addVertex(int edgesToAdd) {
-    Node *vPref;
-    int numNodes = graph->nodes().size();
-    int numEdges = graph->edges().size();
-    QList<Node*> usedNodes;
-    QVector<Node*> nodes = graph->nodes(); /* important: doesn't contain the new node */
+    int numNodes = graph->nodes().size(); /* important: doesn't count the new node */
+    QVector<Node*> usedNodes;
     Node *vertex = graph->newNode();
 
     // saftey check to ensure that the method
@@ -85,10 +86,10 @@ void BarabasiAlbert::addVertex(int edgesToAdd) {
     }
 
     while (edgesToAdd > 0) {
-        vPref = getPreference(nodes, genRandom());
+        Node *vPref = preferredNode(numNodes);
         int cutOff;
         for (cutOff = 0; cutOff < 100 && !graph->newEdge(vertex, vPref); ++cutOff) {
-            vPref = getPreference(nodes, genRandom());
+            vPref = preferredNode(numNodes);
         }
         if (cutOff == 100)
             break;
@@ -96,53 +97,48 @@ void BarabasiAlbert::addVertex(int edgesToAdd) {
         --edgesToAdd;
 
         usedNodes << vPref;
-
-        if (usedNodes.size() >= numNodes)
-            break;
     }
 
-    updatePreference(graph->nodes(), 2 * numEdges);
+    // Only now, so that the new node can't be picked for itself
+    foreach (Node *node, usedNodes) {
+        endpoints << vertex << node;
+    }
 }
 
+// Attaching in proportion to the degree plus this gives a tail exponent of
+// 3 + attractiveness / nodeDegree.
+double BarabasiAlbert::attractiveness() const {
+    return (exponent - 3.0) * nodeDegree;
+}
 
-void BarabasiAlbert::updatePreference(const QVector<Node*> &nodes, int totalDegree) {
-    int prefCumulative = 0;
+// Pick one of the first existing nodes, with a probability proportional to
+// its degree plus the attractiveness.
+Node* BarabasiAlbert::preferredNode(int existing) {
+    const QVector<Node*> &nodes = graph->nodes();
+    double a = attractiveness();
 
-    if (nodes.size() == 1) {
-        preferences[nodes.first()->tag()] = 100;
-        cumulativePreferences[nodes.first()->tag()] = 100;
-        return;
+    if (endpoints.isEmpty()) {
+        return nodes[qrand() % existing];
     }
 
-    foreach (Node *node, nodes) {
-        double tempLength = (double)node->edges().length();
-        double tempPref = (tempLength / (double) totalDegree) * 100;
-        preferences[node->tag()] = tempPref;
-        cumulativePreferences[node->tag()] = prefCumulative;
-        prefCumulative += tempPref;
-    }
-}
-
-// Return the preferred node, using binary search.
-Node* BarabasiAlbert::getPreference(const QVector<Node*> &nodes, double genPref) {
-    const float E = 0.0001;
-    int l;
-    for (l = 1; l < nodes.size(); l <<= 1)
-        ;
-    int i(0);
-    for (; l > 0; l >>= 1) {
-        if (l + i < nodes.size()) {
-            if (cumulativePreferences[l + i] <= genPref + E)
-                i += l;
+    // A positive attractiveness is a uniform choice mixed in...
+    if (a >= 0) {
+        double uniform = a * existing;
+        if ((double)qrand() / RAND_MAX * (uniform + endpoints.size()) < uniform) {
+            return nodes[qrand() % existing];
         }
+        return endpoints[qrand() % endpoints.size()];
     }
-    return nodes[i];
-}
 
-// Generate random double with 4 precision.
-double BarabasiAlbert::genRandom(){
-    double main = qrand() % 100;
-    return main + (( qrand() % 10000 ) / 10000 );
+    // ...and a negative one is some of the degree choices turned down.
+    Node *node = endpoints[qrand() % endpoints.size()];
+    for (int tries(0); tries < 100; ++tries) {
+        double degree = node->edges().size();
+        if ((double)qrand() / RAND_MAX * degree < degree + a)
+            break;
+        node = endpoints[qrand() % endpoints.size()];
+    }
+    return node;
 }
 
 void BarabasiAlbert::onSizeChanged(int newSize) {
@@ -163,6 +159,15 @@ void BarabasiAlbert::onDegreeChanged(int newDegree) {
     graph->repopulate();
 }
 
+void BarabasiAlbert::onExponentChanged(double newExponent) {
+    if (newExponent == exponent)
+        return;
+
+    exponent = newExponent;
+    updateUI();
+    graph->repopulate();
+}
+
 void BarabasiAlbert::updateUI() {
     if (!barabasiCtl)
         return;
@@ -173,4 +178,7 @@ void BarabasiAlbert::updateUI() {
     if (barabasiCtl->degreeEdit->value() != nodeDegree) {
         barabasiCtl->degreeEdit->setValue(nodeDegree);
     }
+    if (barabasiCtl->exponentEdit->value() != exponent) {
+        barabasiCtl->exponentEdit->setValue(exponent);
+    }
 }
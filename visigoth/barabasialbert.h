@@ -5,8 +5,6 @@
 #include "edge.h"
 #include "node.h"
 
-#include <QList>
-#include <QMap>
 #include <QVector>
 
 class GraphScene;
@@ -25,6 +23,7 @@ public:
 
     int getNumNodes() const;
     int getNodeDegree() const;
+    double getExponent() const;
 
     void reset();
     bool canAddVertex();
@@ -34,31 +33,33 @@ public:
 protected slots:
     void onSizeChanged(int newSize);
     void onDegreeChanged(int newDegree);
+    void onExponentChanged(double newExponent);
 
 protected:
     void addVertex(bool saveSize = false);
     void addVertex(int edgesToAdd);
 
-    double genRandom();
-    Node* getPreference(const QVector<Node*> &nodes, double genPref);
-    void updatePreference(const QVector<Node*> &nodes, int numEdges);
+    double attractiveness() const;
+    Node* preferredNode(int existing);
 
     void updateUI();
 
 private:
     static const int START_NODES = 300;
     static const int START_DEGREE = 3;
+    static const double START_EXPONENT = 3.0;
     GraphScene *graph;
     QWidget *ctlW;
     Ui::BarabasiControl *barabasiCtl;
 
-    // used for selecting a node by preferential seleciton
-    QMap<int, double> cumulativePreferences;
-    // used for display purposes only
-    QMap<int, double> preferences;
+    // Both ends of every edge, so that a uniformly random entry is a node
+    // picked in proportion to its degree.
+    QVector<Node*> endpoints;
 
     int size;
     int nodeDegree;
+    // Of the degree distribution's power law tail.
+    double exponent;
 };
 
 #endif // BARABASIALBERT_H
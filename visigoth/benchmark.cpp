@@ -0,0 +1,301 @@
+#include <QDebug>
+#include <QObject>
+#include <QtTest/QtTest>
+#include <QTest>
+
+#include <math.h>
+
+#include "compactgraph.h"
+#include "graphscene.h"
+#include "node.h"
+#include "statistics.h"
+
+class Benchmark : public QObject {
+Q_OBJECT
+public:
+    Benchmark(QObject *parent = 0) :
+        QObject(parent)
+    {
+    }
+
+    virtual ~Benchmark() {
+    }
+
+private slots:
+    void init() {
+        scene = new GraphScene();
+    }
+
+    void repulsion_data() {
+        QTest::addColumn<int>("size");
+        QTest::addColumn<int>("mode");
+
+        QTest::newRow("quadtree 1e5") << 100000 << (int)GraphScene::REPULSION_QUADTREE;
+        QTest::newRow("grid 1e5") << 100000 << (int)GraphScene::REPULSION_GRID;
+        QTest::newRow("quadtree 1e6") << 1000000 << (int)GraphScene::REPULSION_QUADTREE;
+        QTest::newRow("grid 1e6") << 1000000 << (int)GraphScene::REPULSION_GRID;
+    }
+
+    // Time per frame of the layout, for each way of calculating the repulsion.
+    void repulsion() {
+        QFETCH(int, size);
+        QFETCH(int, mode);
+
+        populate(size);
+        scene->setRepulsionMode((GraphScene::REPULSION_MODES)mode);
+
+        QBENCHMARK {
+            scene->calculateForces();
+        }
+    }
+
+    void crossover_data() {
+        QTest::addColumn<int>("size");
+        QTest::addColumn<int>("mode");
+
+        int sizes[] = { 250, 500, 1000, 2000, 4000 };
+        for (int i(0); i < 5; ++i) {
+            QTest::newRow(qPrintable(QString("quadtree %1").arg(sizes[i])))
+                << sizes[i] << (int)GraphScene::REPULSION_QUADTREE;
+            QTest::newRow(qPrintable(QString("exact %1").arg(sizes[i])))
+                << sizes[i] << (int)GraphScene::REPULSION_EXACT;
+        }
+    }
+
+    // Where the exact repulsion stops being cheaper than the QuadTree, see
+    // ExactForces::CROSSOVER.
+    void crossover() {
+        repulsion();
+    }
+
+    void scaling_data() {
+        QTest::addColumn<int>("size");
+        QTest::addColumn<int>("mode");
+
+        int sizes[] = { 10000, 100000, 1000000 };
+        for (int i(0); i < 3; ++i) {
+            QTest::newRow(qPrintable(QString("quadtree %1").arg(sizes[i])))
+                << sizes[i] << (int)GraphScene::REPULSION_QUADTREE;
+            QTest::newRow(qPrintable(QString("fmm %1").arg(sizes[i])))
+                << sizes[i] << (int)GraphScene::REPULSION_FMM;
+        }
+    }
+
+    // The time per frame of the fast multipole method should grow linearly
+    // with the nodes, and the QuadTree's as n log n.
+    void scaling() {
+        repulsion();
+    }
+
+    void quadrupoles_data() {
+        QTest::addColumn<bool>("quadrupoles");
+        QTest::addColumn<double>("tolerance");
+
+        QTest::newRow("monopole 0.6") << false << 0.6;
+        QTest::newRow("monopole 0.8") << false << 0.8;
+        QTest::newRow("quadrupole 0.8") << true << 0.8;
+        QTest::newRow("quadrupole 1.0") << true << 1.0;
+        QTest::newRow("quadrupole 1.2") << true << 1.2;
+    }
+
+    // Accuracy and time per frame of the QuadTree with and without
+    // quadrupoles, at 1e5 nodes.
+    void quadrupoles() {
+        QFETCH(bool, quadrupoles);
+        QFETCH(double, tolerance);
+
+        populate(100000);
+        scene->setRepulsionMode(GraphScene::REPULSION_QUADTREE);
+        scene->setQuadrupoles(quadrupoles);
+        scene->setTolerance(tolerance);
+
+        scene->setInstrumented(true);
+        scene->calculateForces();
+        const GraphScene::LayoutStats &stats = scene->layoutStats();
+        qDebug() << "error rms" << stats.rmsError << "max" << stats.maxError
+                 << "interactions per node" << stats.interactions / 100000.0;
+        scene->setInstrumented(false);
+
+        QBENCHMARK {
+            scene->calculateForces();
+        }
+    }
+
+    // Breadth first search from every node of a 20k node fixture.
+    void averagePathLength() {
+        populate(20000);
+
+        QBENCHMARK {
+            scene->getStatistics()->lengthAvg();
+        }
+    }
+
+    void diameter_data() {
+        QTest::addColumn<bool>("scaleFree");
+        QTest::addColumn<int>("size");
+
+        int sizes[] = { 10000, 100000, 1000000 };
+        for (int i(0); i < 3; ++i) {
+            QTest::newRow(qPrintable(QString("barabasi albert %1").arg(sizes[i]))) << true << sizes[i];
+            QTest::newRow(qPrintable(QString("watts strogatz %1").arg(sizes[i]))) << false << sizes[i];
+        }
+    }
+
+    // The exact diameter and radius, and how many searches DiameterBounds
+    // needed in place of one from every vertex.  Most of a Watts Strogatz
+    // graph is on the fringes iFUB has to search, so it is the slow case.
+    void diameter() {
+        QFETCH(bool, scaleFree);
+        QFETCH(int, size);
+
+        CompactGraph graph = scaleFree ? barabasiAlbert(size) : wattsStrogatz(size);
+        Statistics::DiameterStatistics result;
+        QBENCHMARK {
+            result = Statistics::diameterStatisticsOf(graph);
+        }
+        qDebug() << "diameter" << result.diameter << "radius" << result.radius
+                 << "searches" << result.searches;
+    }
+
+    void communities_data() {
+        QTest::addColumn<bool>("scaleFree");
+        QTest::addColumn<int>("size");
+
+        // A million edges each
+        QTest::newRow("barabasi albert 333333") << true << 333333;
+        QTest::newRow("watts strogatz 500000") << false << 500000;
+    }
+
+    // Louvain communities, and how much of their structure there is.
+    void communities() {
+        QFETCH(bool, scaleFree);
+        QFETCH(int, size);
+
+        CompactGraph graph = scaleFree ? barabasiAlbert(size) : wattsStrogatz(size);
+        Statistics::CommunityStatistics result;
+        QBENCHMARK {
+            result = Statistics::communityStatisticsOf(graph);
+        }
+        qDebug() << result.count << "communities, modularity" << result.modularity
+                 << "levels" << result.levels;
+    }
+
+    void pageRank_data() {
+        QTest::addColumn<bool>("warm");
+        QTest::addColumn<int>("size");
+
+        int sizes[] = { 100000, 1000000 };
+        for (int i(0); i < 2; ++i) {
+            QTest::newRow(qPrintable(QString("cold %1").arg(sizes[i]))) << false << sizes[i];
+            QTest::newRow(qPrintable(QString("warm %1").arg(sizes[i]))) << true << sizes[i];
+        }
+    }
+
+    // PageRank of a Barabasi Albert graph just after one more vertex was
+    // added, iterated from scratch or from the ranks before it was.
+    void pageRank() {
+        QFETCH(bool, warm);
+        QFETCH(int, size);
+
+        qsrand(1);
+        CompactGraph before = barabasiAlbert(size);
+        qsrand(1);
+        CompactGraph graph = barabasiAlbert(size + 1);
+        QVector<double> start;
+        if (warm) {
+            start = Statistics::pageRankOf(before).scores;
+        }
+
+        Statistics::VertexScores result;
+        QBENCHMARK {
+            result = Statistics::pageRankOf(graph, start);
+        }
+        qDebug() << "iterations" << result.iterations;
+    }
+
+    void multiSource_data() {
+        QTest::addColumn<bool>("bitParallel");
+
+        QTest::newRow("single source") << false;
+        QTest::newRow("bit parallel") << true;
+    }
+
+    // One thread searching from the first 1024 nodes of a 20k node fixture,
+    // one source at a time or BitParallelSearch::SOURCES at a time.
+    void multiSource() {
+        QFETCH(bool, bitParallel);
+
+        populate(20000);
+        CompactGraph graph(scene->nodes());
+        BreadthFirst bfs(graph);
+        BitParallelSearch search(graph);
+
+        qint64 sum = 0;
+        QBENCHMARK {
+            sum = 0;
+            if (bitParallel) {
+                for (int v(0); v < 1024; v += BitParallelSearch::SOURCES) {
+                    search.search(v, BitParallelSearch::SOURCES);
+                    sum += search.distanceSum();
+                }
+            } else {
+                for (int v(0); v < 1024; ++v) {
+                    sum += bfs.distanceSum(v);
+                }
+            }
+        }
+        qDebug() << "distance sum" << sum;
+    }
+
+    void cleanup() {
+        delete scene;
+    }
+
+private:
+    GraphScene *scene;
+
+    // A sparse random graph, spread out as if it had already been laid out.
+    void populate(int size) {
+        int side = (int)(30 * sqrt((double)size));
+        for (int i(0); i < size; ++i) {
+            Node *node = scene->newNode();
+            node->setPos(VPointF(qrand() % side, qrand() % side), true);
+        }
+        for (int i(1); i < size; ++i) {
+            scene->newEdge(scene->nodes()[i], scene->nodes()[qrand() % i]);
+        }
+    }
+
+    // Preferential attachment of three edges per vertex, straight into a
+    // CompactGraph; the scene is too slow to build at 1e6 nodes.
+    CompactGraph barabasiAlbert(int size) {
+        QVector<CompactGraph::EdgePair> edges;
+        QVector<int> endpoints;
+        edges << CompactGraph::EdgePair(0, 1);
+        endpoints << 0 << 1;
+        for (int v(2); v < size; ++v) {
+            for (int i(0); i < 3; ++i) {
+                int u = endpoints[qrand() % endpoints.size()];
+                edges << CompactGraph::EdgePair(v, u);
+                endpoints << v << u;
+            }
+        }
+        return CompactGraph(size, edges);
+    }
+
+    // A ring with every vertex joined to its four nearest, a fifth of the
+    // edges rewired at random.
+    CompactGraph wattsStrogatz(int size) {
+        QVector<CompactGraph::EdgePair> edges;
+        for (int v(0); v < size; ++v) {
+            for (int i(1); i <= 2; ++i) {
+                int u = (qrand() % 5 == 0) ? qrand() % size : (v + i) % size;
+                edges << CompactGraph::EdgePair(v, u);
+            }
+        }
+        return CompactGraph(size, edges);
+    }
+};
+
+QTEST_MAIN(Benchmark)
+#include "benchmark.moc"
@@ -0,0 +1,1219 @@
+#include <QHash>
+#include <QThread>
+#include <QtAlgorithms>
+#include <QtConcurrentMap>
+
+#include "compactgraph.h"
+#include "edge.h"
+#include "node.h"
+
+// TriangleCount hands out the vertices to the threads this many at a time.
+static const int VERTEX_CHUNK = 1024;
+
+// A level of Communities stops moving vertices after this many sweeps, or
+// once a sweep raised the modularity by less than MIN_GAIN.  Without much
+// community structure, as in a Barabasi Albert graph, sweeps keep moving
+// vertices for little gain, most of which the next levels make up for.
+static const int MAX_SWEEPS = 32;
+static const double MIN_GAIN = 3e-3;
+
+// A BitParallelSearch takes 96 bytes a vertex, so DiameterBounds keeps no
+// more than this many whatever the number of threads.
+static const int MAX_FRINGE_SEARCHES = 8;
+
+static inline int popCount(quint64 x) {
+#ifdef __GNUC__
+    return __builtin_popcountll(x);
+#else
+    int count = 0;
+    for (; x; x &= x - 1) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+
+// ---------------------------------------------------------------------------
+// CompactGraph
+
+CompactGraph::CompactGraph() {
+    build(0, QVector<EdgePair>());
+}
+
+CompactGraph::CompactGraph(const QVector<Node*> &nodes) {
+    QHash<Node*, int> index;
+    index.reserve(nodes.size());
+    for (int i(0); i < nodes.size(); ++i) {
+        index.insert(nodes[i], i);
+    }
+
+    // Every edge is in the lists of both of its nodes, build() removes the
+    // second copy.
+    QVector<EdgePair> edges;
+    for (int i(0); i < nodes.size(); ++i) {
+        foreach (Edge *edge, nodes[i]->edges()) {
+            int u = index.value(edge->sourceNode(), -1);
+            int v = index.value(edge->destNode(), -1);
+            if (u >= 0 && v >= 0) {
+                edges << EdgePair(u, v);
+            }
+        }
+    }
+
+    build(nodes.size(), edges);
+}
+
+CompactGraph::CompactGraph(int vertexCount, const QVector<EdgePair> &edges) {
+    build(vertexCount, edges);
+}
+
+int CompactGraph::vertexCount() const {
+    return offsets.size() - 1;
+}
+
+int CompactGraph::edgeCount() const {
+    return targets.size() / 2;
+}
+
+int CompactGraph::degree(int v) const {
+    return offsets[v + 1] - offsets[v];
+}
+
+bool CompactGraph::adjacent(int u, int v) const {
+    return qBinaryFind(neighboursBegin(u), neighboursEnd(u), v) != neighboursEnd(u);
+}
+
+const int* CompactGraph::neighboursBegin(int v) const {
+    return targets.constData() + offsets[v];
+}
+
+const int* CompactGraph::neighboursEnd(int v) const {
+    return targets.constData() + offsets[v + 1];
+}
+
+void CompactGraph::build(int vertexCount, const QVector<EdgePair> &edges) {
+    // Count both directions of every edge, then place them.
+    offsets.fill(0, vertexCount + 1);
+    foreach (const EdgePair &e, edges) {
+        if (e.first != e.second) {
+            ++offsets[e.first + 1];
+            ++offsets[e.second + 1];
+        }
+    }
+    for (int v(0); v < vertexCount; ++v) {
+        offsets[v + 1] += offsets[v];
+    }
+
+    QVector<int> next(offsets);
+    QVector<int> all(offsets[vertexCount]);
+    foreach (const EdgePair &e, edges) {
+        if (e.first != e.second) {
+            all[next[e.first]++] = e.second;
+            all[next[e.second]++] = e.first;
+        }
+    }
+
+    // Sort each list and compact away the duplicates.
+    targets.resize(all.size());
+    int end = 0;
+    for (int v(0); v < vertexCount; ++v) {
+        int *begin = all.data() + offsets[v];
+        int *last = all.data() + offsets[v + 1];
+        qSort(begin, last);
+
+        offsets[v] = end;
+        for (int *t = begin; t != last; ++t) {
+            if (t == begin || *t != *(t - 1)) {
+                targets[end++] = *t;
+            }
+        }
+    }
+    offsets[vertexCount] = end;
+    targets.resize(end);
+}
+
+
+// ---------------------------------------------------------------------------
+// Components
+
+Components::Components(const CompactGraph &graph) :
+    largest(-1)
+{
+    const int n = graph.vertexCount();
+
+    // Union by size, with path halving.
+    QVector<int> parent(n);
+    QVector<int> weight(n, 1);
+    for (int v(0); v < n; ++v) {
+        parent[v] = v;
+    }
+    for (int u(0); u < n; ++u) {
+        for (const int *t = graph.neighboursBegin(u); t != graph.neighboursEnd(u); ++t) {
+            if (*t < u) {
+                continue;
+            }
+            int a = u;
+            int b = *t;
+            while (parent[a] != a) {
+                a = parent[a] = parent[parent[a]];
+            }
+            while (parent[b] != b) {
+                b = parent[b] = parent[parent[b]];
+            }
+            if (a != b) {
+                if (weight[a] < weight[b]) {
+                    qSwap(a, b);
+                }
+                parent[b] = a;
+                weight[a] += weight[b];
+            }
+        }
+    }
+
+    // Number the roots as they are first met.
+    QVector<int> rootLabels(n, -1);
+    labels.resize(n);
+    for (int v(0); v < n; ++v) {
+        int root = v;
+        while (parent[root] != root) {
+            root = parent[root];
+        }
+        if (rootLabels[root] < 0) {
+            rootLabels[root] = sizes.size();
+            sizes << weight[root];
+            if (largest < 0 || weight[root] > sizes[largest]) {
+                largest = rootLabels[root];
+            }
+        }
+        labels[v] = rootLabels[root];
+    }
+}
+
+int Components::count() const {
+    return sizes.size();
+}
+
+int Components::component(int v) const {
+    return labels[v];
+}
+
+int Components::size(int c) const {
+    return sizes[c];
+}
+
+int Components::giant() const {
+    return largest;
+}
+
+qint64 Components::connectedPairs() const {
+    qint64 pairs = 0;
+    foreach (int s, sizes) {
+        pairs += (qint64) s * (s - 1);
+    }
+    return pairs;
+}
+
+
+// ---------------------------------------------------------------------------
+// BreadthFirst
+
+BreadthFirst::BreadthFirst(const CompactGraph &graph) :
+    graph(graph),
+    distances(graph.vertexCount()),
+    stamps(graph.vertexCount()),
+    queue(graph.vertexCount()),
+    generation(0),
+    queueEnd(0)
+{
+}
+
+qint64 BreadthFirst::distanceSum(int source) {
+    search(source);
+
+    qint64 sum = 0;
+    for (int i(0); i < queueEnd; ++i) {
+        sum += distances[queue[i]];
+    }
+    return sum;
+}
+
+int BreadthFirst::eccentricity(int source) {
+    search(source);
+    return distances[queue[queueEnd - 1]];
+}
+
+int BreadthFirst::reached() const {
+    return queueEnd;
+}
+
+int BreadthFirst::distance(int v) const {
+    return (stamps[v] == generation) ? distances[v] : -1;
+}
+
+void BreadthFirst::search(int source) {
+    // Clear the stamps only once every 2^32 searches.
+    if (++generation == 0) {
+        stamps.fill(0);
+        generation = 1;
+    }
+
+    int *q = queue.data();
+    int *dist = distances.data();
+    unsigned int *stamp = stamps.data();
+
+    int head = 0;
+    int tail = 0;
+    q[tail++] = source;
+    stamp[source] = generation;
+    dist[source] = 0;
+
+    while (head < tail) {
+        int u = q[head++];
+        int next = dist[u] + 1;
+
+        const int *end = graph.neighboursEnd(u);
+        for (const int *v = graph.neighboursBegin(u); v != end; ++v) {
+            if (stamp[*v] != generation) {
+                stamp[*v] = generation;
+                dist[*v] = next;
+                q[tail++] = *v;
+            }
+        }
+    }
+
+    queueEnd = tail;
+}
+
+
+// ---------------------------------------------------------------------------
+// Dependencies
+
+Dependencies::Dependencies(const CompactGraph &graph) :
+    graph(graph),
+    distances(graph.vertexCount(), -1),
+    paths(graph.vertexCount(), 0.0),
+    dependencies(graph.vertexCount(), 0.0),
+    order(graph.vertexCount())
+{
+}
+
+void Dependencies::accumulate(int source, QVector<double> &sums) {
+    int *dist = distances.data();
+    double *sigma = paths.data();
+    double *delta = dependencies.data();
+    int *q = order.data();
+
+    int head = 0;
+    int tail = 0;
+    q[tail++] = source;
+    dist[source] = 0;
+    sigma[source] = 1.0;
+
+    // Count the shortest paths, level by level.
+    while (head < tail) {
+        int u = q[head++];
+        const int *end = graph.neighboursEnd(u);
+        for (const int *v = graph.neighboursBegin(u); v != end; ++v) {
+            if (dist[*v] < 0) {
+                dist[*v] = dist[u] + 1;
+                q[tail++] = *v;
+            }
+            if (dist[*v] == dist[u] + 1) {
+                sigma[*v] += sigma[u];
+            }
+        }
+    }
+
+    // Then hand the dependencies back up them, furthest first.
+    for (int i(tail - 1); i > 0; --i) {
+        int w = q[i];
+        double share = (1.0 + delta[w]) / sigma[w];
+        const int *end = graph.neighboursEnd(w);
+        for (const int *v = graph.neighboursBegin(w); v != end; ++v) {
+            if (dist[*v] == dist[w] - 1) {
+                delta[*v] += sigma[*v] * share;
+            }
+        }
+        sums[w] += delta[w];
+    }
+
+    for (int i(0); i < tail; ++i) {
+        int w = q[i];
+        dist[w] = -1;
+        sigma[w] = 0.0;
+        delta[w] = 0.0;
+    }
+}
+
+
+// ---------------------------------------------------------------------------
+// DiameterBounds::FringeBatch
+
+// Vertices of the fringe searched on one thread, and their eccentricities.
+class DiameterBounds::FringeBatch {
+public:
+    FringeBatch() : search(0) { }
+
+    QVector<int> sources;
+    QVector<int> eccentricities;
+    BitParallelSearch *search;
+};
+
+
+// ---------------------------------------------------------------------------
+// DiameterBounds
+
+DiameterBounds::DiameterBounds(const CompactGraph &graph) :
+    graph(graph),
+    bfs(graph),
+    lower(graph.vertexCount(), 0),
+    upper(graph.vertexCount(), graph.vertexCount()),
+    diameterLow(0),
+    diameterHigh(0),
+    radiusLow(0),
+    radiusHigh(0),
+    searchCount(0),
+    highest(true),
+    nextFringe(0),
+    fringe(0)
+{
+    Components components(graph);
+    for (int v(0); v < graph.vertexCount(); ++v) {
+        if (components.component(v) == components.giant()) {
+            giant << v;
+        }
+    }
+    remaining = giant;
+
+    // No eccentricity reaches the number of vertices.
+    if (!giant.isEmpty()) {
+        diameterHigh = graph.vertexCount();
+        radiusHigh = graph.vertexCount();
+    }
+}
+
+DiameterBounds::~DiameterBounds() {
+    qDeleteAll(fringeSearches);
+}
+
+bool DiameterBounds::isExact() const {
+    return diameterLow == diameterHigh && radiusLow == radiusHigh;
+}
+
+void DiameterBounds::refine() {
+    if (radiusLow < radiusHigh) {
+        searchForRadius();
+    } else if (diameterLow < diameterHigh) {
+        searchFringe();
+    }
+}
+
+int DiameterBounds::diameter() const {
+    return diameterLow;
+}
+
+int DiameterBounds::radius() const {
+    return radiusHigh;
+}
+
+int DiameterBounds::searches() const {
+    return searchCount;
+}
+
+void DiameterBounds::searchForRadius() {
+    // The far ends of the component raise the lower bounds the most.
+    const QVector<int> &choices = highest ? giant : remaining;
+    int source = choices[0];
+    foreach (int w, choices) {
+        int a = highest ? upper[w] : -lower[w];
+        int b = highest ? upper[source] : -lower[source];
+        if (a > b || (a == b && graph.degree(w) > graph.degree(source))) {
+            source = w;
+        }
+    }
+    highest = !highest;
+    bound(source, bfs.eccentricity(source));
+
+    // The dropped vertices are within the bounds already.
+    radiusLow = radiusHigh;
+    int kept = 0;
+    foreach (int w, remaining) {
+        if (lower[w] < radiusHigh) {
+            remaining[kept++] = w;
+            radiusLow = qMin(radiusLow, lower[w]);
+        }
+    }
+    remaining.resize(kept);
+}
+
+void DiameterBounds::searchFringe() {
+    if (fringes.isEmpty()) {
+        // Any vertex whose upper bound is the radius is a centre.
+        int centre = giant[0];
+        foreach (int w, giant) {
+            if (upper[w] < upper[centre]) {
+                centre = w;
+            }
+        }
+        fringe = bfs.eccentricity(centre);
+        bound(centre, fringe);
+
+        // Sort the vertices by their distance, furthest first.
+        centreDistances.resize(graph.vertexCount());
+        QVector<int> starts(fringe + 2, 0);
+        foreach (int w, giant) {
+            centreDistances[w] = bfs.distance(w);
+            ++starts[fringe - centreDistances[w] + 1];
+        }
+        for (int i(1); i < starts.size(); ++i) {
+            starts[i] += starts[i - 1];
+        }
+        fringes.resize(giant.size());
+        foreach (int w, giant) {
+            fringes[starts[fringe - centreDistances[w]]++] = w;
+        }
+        return;
+    }
+
+    // Alternately, the vertex with the highest upper bound, whose search
+    // tightens everyone's.
+    highest = !highest;
+    if (highest) {
+        int source = giant[0];
+        foreach (int w, giant) {
+            if (upper[w] > upper[source]) {
+                source = w;
+            }
+        }
+        if (upper[source] > diameterLow) {
+            bound(source, bfs.eccentricity(source));
+            return;
+        }
+    }
+
+    // Only their eccentricities matter, so they are searched together.  The
+    // searchers are only made once a fringe has enough batches for them.
+    const int threads = qBound(1, QThread::idealThreadCount(), MAX_FRINGE_SEARCHES);
+    QVector<FringeBatch> batches;
+    while (diameterLow < diameterHigh && batches.isEmpty()) {
+        while (batches.size() < threads && nextFringe < fringes.size()
+               && centreDistances[fringes[nextFringe]] == fringe) {
+            FringeBatch batch;
+            while (batch.sources.size() < BitParallelSearch::SOURCES && nextFringe < fringes.size()
+                   && centreDistances[fringes[nextFringe]] == fringe) {
+                int w = fringes[nextFringe++];
+                if (upper[w] > diameterLow) {
+                    batch.sources << w;
+                }
+            }
+            if (!batch.sources.isEmpty()) {
+                if (batches.size() == fringeSearches.size()) {
+                    fringeSearches << new BitParallelSearch(graph);
+                }
+                batch.search = fringeSearches[batches.size()];
+                batches << batch;
+            }
+        }
+
+        if (batches.isEmpty()) {
+            // A longer path than 2(fringe - 1) has an end on a fringe that
+            // has been searched.
+            diameterHigh = qMin(diameterHigh, qMax(diameterLow, 2 * (fringe - 1)));
+            --fringe;
+        }
+    }
+
+    QtConcurrent::blockingMap(batches, &DiameterBounds::searchBatch);
+    foreach (const FringeBatch &batch, batches) {
+        searchCount += batch.sources.size();
+        for (int i(0); i < batch.sources.size(); ++i) {
+            upper[batch.sources[i]] = batch.eccentricities[i];
+            diameterLow = qMax(diameterLow, batch.eccentricities[i]);
+        }
+    }
+}
+
+void DiameterBounds::searchBatch(FringeBatch &batch) {
+    batch.search->search(batch.sources);
+    for (int i(0); i < batch.sources.size(); ++i) {
+        batch.eccentricities << batch.search->eccentricity(i);
+    }
+}
+
+// Tightens every bound with the search just made from the source.
+void DiameterBounds::bound(int source, int eccentricity) {
+    ++searchCount;
+    upper[source] = eccentricity;
+    diameterLow = qMax(diameterLow, eccentricity);
+
+    int highestUpper = 0;
+    foreach (int w, giant) {
+        int d = bfs.distance(w);
+        lower[w] = qMax(lower[w], qMax(d, eccentricity - d));
+        upper[w] = qMin(upper[w], eccentricity + d);
+        diameterLow = qMax(diameterLow, lower[w]);
+        radiusHigh = qMin(radiusHigh, upper[w]);
+        highestUpper = qMax(highestUpper, upper[w]);
+    }
+    diameterHigh = qMin(diameterHigh, qMin(highestUpper, 2 * radiusHigh));
+}
+
+
+// ---------------------------------------------------------------------------
+// BitParallelSearch
+
+BitParallelSearch::BitParallelSearch(const CompactGraph &graph) :
+    graph(graph),
+    seen(graph.vertexCount() * WORDS),
+    frontier(graph.vertexCount() * WORDS),
+    next(graph.vertexCount() * WORDS)
+{
+}
+
+void BitParallelSearch::search(int first, int count) {
+    QVector<int> sources(count);
+    for (int i(0); i < count; ++i) {
+        sources[i] = first + i;
+    }
+    search(sources);
+}
+
+void BitParallelSearch::search(const QVector<int> &sources) {
+    const int n = graph.vertexCount();
+    const int count = sources.size();
+
+    seen.fill(0);
+    frontier.fill(0);
+    eccentricities.fill(0, count);
+    counts.clear();
+    counts << count;
+
+    quint64 active[WORDS] = { 0 };
+    for (int i(0); i < count; ++i) {
+        quint64 bit = Q_UINT64_C(1) << (i % 64);
+        seen[sources[i] * WORDS + i / 64] |= bit;
+        frontier[sources[i] * WORDS + i / 64] |= bit;
+        active[i / 64] |= bit;
+    }
+
+    for (int d = 1; ; ++d) {
+        quint64 *s = seen.data();
+        quint64 *f = frontier.data();
+        quint64 *nx = next.data();
+
+        quint64 found[WORDS] = { 0 };
+        qint64 foundCount = 0;
+
+        for (int v(0); v < n; ++v) {
+            quint64 *sv = s + v * WORDS;
+            quint64 *nv = nx + v * WORDS;
+
+            // Every search has already been here
+            bool full = true;
+            for (int w(0); w < WORDS; ++w) {
+                full = full && ((sv[w] & active[w]) == active[w]);
+            }
+            if (full) {
+                for (int w(0); w < WORDS; ++w) {
+                    nv[w] = 0;
+                }
+                continue;
+            }
+
+            quint64 reached[WORDS] = { 0 };
+            const int *end = graph.neighboursEnd(v);
+            for (const int *u = graph.neighboursBegin(v); u != end; ++u) {
+                const quint64 *fu = f + *u * WORDS;
+                for (int w(0); w < WORDS; ++w) {
+                    reached[w] |= fu[w];
+                }
+            }
+
+            for (int w(0); w < WORDS; ++w) {
+                quint64 fresh = reached[w] & ~sv[w];
+                nv[w] = fresh;
+                sv[w] |= fresh;
+                found[w] |= fresh;
+                foundCount += popCount(fresh);
+            }
+        }
+
+        if (foundCount == 0) {
+            break;
+        }
+        counts << foundCount;
+
+        // The searches that got anywhere at this distance
+        for (int i(0); i < count; ++i) {
+            if (found[i / 64] & (Q_UINT64_C(1) << (i % 64))) {
+                eccentricities[i] = d;
+            }
+        }
+
+        qSwap(frontier, next);
+    }
+}
+
+qint64 BitParallelSearch::distanceSum() const {
+    qint64 sum = 0;
+    for (int d(1); d < counts.size(); ++d) {
+        sum += d * counts[d];
+    }
+    return sum;
+}
+
+const QVector<qint64>& BitParallelSearch::distanceCounts() const {
+    return counts;
+}
+
+int BitParallelSearch::eccentricity(int i) const {
+    return eccentricities[i];
+}
+
+int BitParallelSearch::maxEccentricity() const {
+    int result = 0;
+    foreach (int e, eccentricities) {
+        result = qMax(result, e);
+    }
+    return result;
+}
+
+
+// ---------------------------------------------------------------------------
+// TriangleCount::Worker
+
+// One thread of TriangleCount::count().  A triangle u, v, w is found from
+// u, the first of them, and counted for all three; only this thread counts
+// for u, but any of them may count for v and w.
+class TriangleCount::Worker {
+public:
+    typedef void result_type;
+
+    Worker(TriangleCount &counter, QAtomicInt &nextChunk) :
+        counter(counter),
+        nextChunk(nextChunk)
+    {
+    }
+
+    void operator()(int) {
+        const int n = counter.graph.vertexCount();
+        const int *offsets = counter.outOffsets.constData();
+        const int *targets = counter.outTargets.constData();
+
+        // marks[w] == u + 1 if w is an out neighbour of the hub u
+        QVector<int> marks;
+
+        int chunk;
+        while ((chunk = nextChunk.fetchAndAddOrdered(1)) * VERTEX_CHUNK < n) {
+            int last = qMin(n, (chunk + 1) * VERTEX_CHUNK);
+            for (int u(chunk * VERTEX_CHUNK); u < last; ++u) {
+                const int *uBegin = targets + offsets[u];
+                const int *uEnd = targets + offsets[u + 1];
+                bool hub = (uEnd - uBegin) > HUB_DEGREE;
+
+                if (hub) {
+                    if (marks.isEmpty()) {
+                        marks.fill(0, n);
+                    }
+                    for (const int *w = uBegin; w != uEnd; ++w) {
+                        marks[*w] = u + 1;
+                    }
+                }
+
+                int found = 0;
+                for (const int *v = uBegin; v != uEnd; ++v) {
+                    const int *vBegin = targets + offsets[*v];
+                    const int *vEnd = targets + offsets[*v + 1];
+                    int foundWithV = 0;
+
+                    if (hub) {
+                        for (const int *w = vBegin; w != vEnd; ++w) {
+                            if (marks[*w] == u + 1) {
+                                counter.counts[*w].fetchAndAddRelaxed(1);
+                                ++foundWithV;
+                            }
+                        }
+                    } else {
+                        const int *a = uBegin;
+                        const int *b = vBegin;
+                        while (a != uEnd && b != vEnd) {
+                            if (*a < *b) {
+                                ++a;
+                            } else if (*b < *a) {
+                                ++b;
+                            } else {
+                                counter.counts[*a].fetchAndAddRelaxed(1);
+                                ++foundWithV;
+                                ++a;
+                                ++b;
+                            }
+                        }
+                    }
+
+                    if (foundWithV > 0) {
+                        counter.counts[*v].fetchAndAddRelaxed(foundWithV);
+                        found += foundWithV;
+                    }
+                }
+
+                if (found > 0) {
+                    counter.counts[u].fetchAndAddRelaxed(found);
+                }
+            }
+        }
+    }
+
+private:
+    TriangleCount &counter;
+    QAtomicInt &nextChunk;
+};
+
+
+// ---------------------------------------------------------------------------
+// TriangleCount
+
+TriangleCount::TriangleCount(const CompactGraph &graph) :
+    graph(graph),
+    counts(graph.vertexCount()),
+    total(0)
+{
+}
+
+void TriangleCount::count() {
+    const int n = graph.vertexCount();
+    orient();
+    counts.fill(QAtomicInt(0));
+
+    const int chunks = (n + VERTEX_CHUNK - 1) / VERTEX_CHUNK;
+    QAtomicInt nextChunk(0);
+    QVector<int> threads;
+    const int threadCount = qBound(1, QThread::idealThreadCount(), qMax(1, chunks));
+    for (int i(0); i < threadCount; ++i) {
+        threads << i;
+    }
+    QtConcurrent::blockingMap(threads, Worker(*this, nextChunk));
+
+    // Every triangle was counted at each of its corners.
+    total = 0;
+    for (int v(0); v < n; ++v) {
+        total += (int) counts[v];
+    }
+    total /= 3;
+}
+
+qint64 TriangleCount::triangles() const {
+    return total;
+}
+
+qint64 TriangleCount::triangles(int v) const {
+    return (int) counts[v];
+}
+
+double TriangleCount::clustering(int v) const {
+    qint64 k = graph.degree(v);
+    return (k > 1) ? (2.0 * (int) counts[v]) / (k * (k - 1)) : 0.0;
+}
+
+double TriangleCount::clusteringAvg() const {
+    const int n = graph.vertexCount();
+    if (n == 0) {
+        return 0.0;
+    }
+
+    double sum = 0.0;
+    for (int v(0); v < n; ++v) {
+        sum += clustering(v);
+    }
+    return sum / n;
+}
+
+double TriangleCount::transitivity() const {
+    qint64 paths = 0;
+    for (int v(0); v < graph.vertexCount(); ++v) {
+        qint64 k = graph.degree(v);
+        paths += k * (k - 1) / 2;
+    }
+    return (paths > 0) ? (3.0 * total) / paths : 0.0;
+}
+
+void TriangleCount::orient() {
+    const int n = graph.vertexCount();
+
+    // The neighbours stay sorted by number, ready to be merged.
+    outOffsets.fill(0, n + 1);
+    outTargets.clear();
+    outTargets.reserve(graph.edgeCount());
+    for (int u(0); u < n; ++u) {
+        const int du = graph.degree(u);
+        const int *end = graph.neighboursEnd(u);
+        for (const int *v = graph.neighboursBegin(u); v != end; ++v) {
+            const int dv = graph.degree(*v);
+            if (du < dv || (du == dv && u < *v)) {
+                outTargets << *v;
+            }
+        }
+        outOffsets[u + 1] = outTargets.size();
+    }
+}
+
+
+// ---------------------------------------------------------------------------
+// AdjacencyProduct::Multiply
+
+// Multiplies the rows of one block at a time.  No other block writes to
+// them, so the threads need no locks.
+class AdjacencyProduct::Multiply {
+public:
+    typedef void result_type;
+
+    Multiply(const AdjacencyProduct &matrix, const double *vector, double *product) :
+        matrix(matrix),
+        vector(vector),
+        product(product)
+    {
+    }
+
+    void operator()(int block) {
+        const int first = block * BLOCK_ROWS;
+        const int last = qMin(matrix.size, first + BLOCK_ROWS);
+        for (int v(first); v < last; ++v) {
+            product[v] = 0.0;
+        }
+
+        const int *rows = matrix.rows.constData();
+        const int *starts = matrix.segmentStarts.constData();
+        const int *columns = matrix.columns.constData();
+        const int end = matrix.blockStarts[block + 1];
+        for (int s(matrix.blockStarts[block]); s < end; ++s) {
+            double sum = 0.0;
+            for (int i(starts[s]); i < starts[s + 1]; ++i) {
+                sum += vector[columns[i]];
+            }
+            product[rows[s]] += sum;
+        }
+    }
+
+private:
+    const AdjacencyProduct &matrix;
+    const double *vector;
+    double *product;
+};
+
+
+// ---------------------------------------------------------------------------
+// AdjacencyProduct
+
+AdjacencyProduct::AdjacencyProduct(const CompactGraph &graph) :
+    size(graph.vertexCount())
+{
+    columns.reserve(2 * graph.edgeCount());
+    blockStarts << 0;
+    segmentStarts << 0;
+
+    QVector<const int*> cursors;
+    for (int first(0); first < size; first += BLOCK_ROWS) {
+        const int last = qMin(size, first + BLOCK_ROWS);
+        cursors.resize(0);
+        for (int v(first); v < last; ++v) {
+            cursors << graph.neighboursBegin(v);
+        }
+
+        // The neighbours are sorted, so each band carries on where the
+        // last one left off.
+        for (int band(0); band < size; band += BAND_COLUMNS) {
+            const int bandEnd = band + BAND_COLUMNS;
+            for (int v(first); v < last; ++v) {
+                const int *&u = cursors[v - first];
+                const int *end = graph.neighboursEnd(v);
+                if (u == end || *u >= bandEnd) {
+                    continue;
+                }
+                for (; u != end && *u < bandEnd; ++u) {
+                    columns << *u;
+                }
+                rows << v;
+                segmentStarts << columns.size();
+            }
+        }
+        blockStarts << rows.size();
+    }
+}
+
+void AdjacencyProduct::multiply(const QVector<double> &vector, QVector<double> &product) const {
+    product.resize(size);
+    QVector<int> blocks;
+    for (int b(0); b + 1 < blockStarts.size(); ++b) {
+        blocks << b;
+    }
+    QtConcurrent::blockingMap(blocks, Multiply(*this, vector.constData(), product.data()));
+}
+
+
+// ---------------------------------------------------------------------------
+// Communities::Mover
+
+// One thread of a sweep of local moving.  A vertex leaves its community,
+// then joins whichever neighbouring one gains the most modularity from it,
+// which is its own again unless another gains strictly more.  Joining c
+// gains the weight of the edges into c less the weight expected there,
+// tot(c) k / 2m for a vertex of strength k, over m.
+class Communities::Mover {
+public:
+    typedef void result_type;
+
+    // Takes the arrays on the calling thread, so none of them detaches on
+    // another.
+    Mover(Communities &communities, QAtomicInt &nextChunk, QVector<double> &gains) :
+        n(communities.strengths.size()),
+        offsets(communities.offsets.constData()),
+        targets(communities.targets.constData()),
+        weights(communities.weights.constData()),
+        strengths(communities.strengths.constData()),
+        labels(communities.labels.data()),
+        totals(communities.totals.data()),
+        total(communities.total),
+        nextChunk(nextChunk),
+        gains(gains.data())
+    {
+    }
+
+    void operator()(int thread) {
+        // The weight of v's edges into each of the communities touched
+        QVector<int> weightTo(n, 0);
+        QVector<int> touched;
+        double gained = 0.0;
+
+        int chunk;
+        while ((chunk = nextChunk.fetchAndAddOrdered(1)) * VERTEX_CHUNK < n) {
+            int last = qMin(n, (chunk + 1) * VERTEX_CHUNK);
+            for (int v(chunk * VERTEX_CHUNK); v < last; ++v) {
+                const int own = labels[v];
+                const int k = strengths[v];
+                for (int i(offsets[v]); i < offsets[v + 1]; ++i) {
+                    const int c = labels[targets[i]];
+                    if (weightTo[c] == 0) {
+                        touched << c;
+                    }
+                    weightTo[c] += weights[i];
+                }
+
+                totals[own].fetchAndAddOrdered(-k);
+                int best = own;
+                const double ownGain = weightTo[own] - (int) totals[own] * (k / total);
+                double bestGain = ownGain;
+                foreach (int c, touched) {
+                    double gain = weightTo[c] - (int) totals[c] * (k / total);
+                    if (gain > bestGain) {
+                        best = c;
+                        bestGain = gain;
+                    }
+                }
+                totals[best].fetchAndAddOrdered(k);
+                if (best != own) {
+                    labels[v] = best;
+                    gained += bestGain - ownGain;
+                }
+
+                foreach (int c, touched) {
+                    weightTo[c] = 0;
+                }
+                touched.resize(0);
+            }
+        }
+        // In modularity
+        gains[thread] = 2 * gained / total;
+    }
+
+private:
+    const int n;
+    const int *offsets;
+    const int *targets;
+    const int *weights;
+    const int *strengths;
+    QAtomicInt *labels;
+    QAtomicInt *totals;
+    const double total;
+    QAtomicInt &nextChunk;
+    double *gains;
+};
+
+
+// ---------------------------------------------------------------------------
+// Communities
+
+Communities::Communities(const CompactGraph &graph) :
+    graph(graph),
+    total(2 * (qint64) graph.edgeCount()),
+    levelCount(0)
+{
+    const int n = graph.vertexCount();
+    offsets << 0;
+    targets.reserve(2 * graph.edgeCount());
+    for (int v(0); v < n; ++v) {
+        const int *end = graph.neighboursEnd(v);
+        for (const int *u = graph.neighboursBegin(v); u != end; ++u) {
+            targets << *u;
+        }
+        offsets << targets.size();
+        strengths << graph.degree(v);
+        membership << v;
+    }
+    weights.fill(1, targets.size());
+
+    labels.resize(n);
+    totals.resize(n);
+    for (int v(0); v < n; ++v) {
+        labels[v] = v;
+        totals[v] = strengths[v];
+    }
+}
+
+bool Communities::refine() {
+    const int n = strengths.size();
+    if (total == 0) {
+        return false;
+    }
+
+    bool movedAny = false;
+    for (int sweep(0); sweep < MAX_SWEEPS; ++sweep) {
+        const int chunks = (n + VERTEX_CHUNK - 1) / VERTEX_CHUNK;
+        QAtomicInt nextChunk(0);
+        QVector<int> threads;
+        const int threadCount = qBound(1, QThread::idealThreadCount(), chunks);
+        for (int i(0); i < threadCount; ++i) {
+            threads << i;
+        }
+        QVector<double> gains(threadCount, 0.0);
+        QtConcurrent::blockingMap(threads, Mover(*this, nextChunk, gains));
+
+        double gain = 0.0;
+        foreach (double threadGain, gains) {
+            gain += threadGain;
+        }
+        movedAny = movedAny || gain > 0.0;
+        if (gain < MIN_GAIN) {
+            break;
+        }
+    }
+    if (!movedAny) {
+        return false;
+    }
+
+    aggregate();
+    ++levelCount;
+    // Vertices swapping communities would leave as many as there were.
+    return strengths.size() < n;
+}
+
+int Communities::count() const {
+    return strengths.size();
+}
+
+int Communities::community(int v) const {
+    return membership[v];
+}
+
+double Communities::modularity() const {
+    if (total == 0) {
+        return 0.0;
+    }
+
+    qint64 inside = 0;
+    for (int v(0); v < graph.vertexCount(); ++v) {
+        const int *end = graph.neighboursEnd(v);
+        for (const int *u = graph.neighboursBegin(v); u != end; ++u) {
+            if (membership[*u] == membership[v]) {
+                ++inside;
+            }
+        }
+    }
+    double expected = 0.0;
+    foreach (int strength, strengths) {
+        expected += (strength / (double) total) * (strength / (double) total);
+    }
+    return inside / (double) total - expected;
+}
+
+int Communities::levels() const {
+    return levelCount;
+}
+
+// Makes each community of the current level a vertex of the next, with an
+// edge to each neighbouring community weighted by the edges between them.
+void Communities::aggregate() {
+    const int n = strengths.size();
+
+    // Numbered in the order of their first vertices
+    QVector<int> renumbered(n, -1);
+    int count = 0;
+    for (int v(0); v < n; ++v) {
+        int &c = renumbered[labels[v]];
+        if (c < 0) {
+            c = count++;
+        }
+    }
+    QVector<int> next(n);
+    for (int v(0); v < n; ++v) {
+        next[v] = renumbered[labels[v]];
+    }
+    for (int i(0); i < membership.size(); ++i) {
+        membership[i] = next[membership[i]];
+    }
+
+    // The vertices of each community, by counting sort
+    QVector<int> memberStarts(count + 1, 0);
+    for (int v(0); v < n; ++v) {
+        ++memberStarts[next[v] + 1];
+    }
+    for (int c(0); c < count; ++c) {
+        memberStarts[c + 1] += memberStarts[c];
+    }
+    QVector<int> members(n);
+    QVector<int> cursors = memberStarts;
+    for (int v(0); v < n; ++v) {
+        members[cursors[next[v]]++] = v;
+    }
+
+    QVector<int> nextOffsets;
+    QVector<int> nextTargets;
+    QVector<int> nextWeights;
+    QVector<int> nextStrengths(count, 0);
+    QVector<int> weightTo(count, 0);
+    QVector<int> touched;
+    nextOffsets << 0;
+    for (int c(0); c < count; ++c) {
+        for (int m(memberStarts[c]); m < memberStarts[c + 1]; ++m) {
+            const int v = members[m];
+            nextStrengths[c] += strengths[v];
+            for (int i(offsets[v]); i < offsets[v + 1]; ++i) {
+                const int d = next[targets[i]];
+                if (d == c) {
+                    continue;
+                }
+                if (weightTo[d] == 0) {
+                    touched << d;
+                }
+                weightTo[d] += weights[i];
+            }
+        }
+        foreach (int d, touched) {
+            nextTargets << d;
+            nextWeights << weightTo[d];
+            weightTo[d] = 0;
+        }
+        touched.resize(0);
+        nextOffsets << nextTargets.size();
+    }
+
+    offsets = nextOffsets;
+    targets = nextTargets;
+    weights = nextWeights;
+    strengths = nextStrengths;
+    labels.resize(count);
+    totals.resize(count);
+    for (int c(0); c < count; ++c) {
+        labels[c] = c;
+        totals[c] = strengths[c];
+    }
+}
@@ -0,0 +1,359 @@
+#ifndef COMPACTGRAPH_H
+#define COMPACTGRAPH_H
+
+#include <QAtomicInt>
+#include <QPair>
+#include <QVector>
+
+class BitParallelSearch;
+class Node;
+
+/* A read-only snapshot of an undirected graph in compressed sparse row form:
+ * the neighbours of vertex v are targets[offsets[v]] to
+ * targets[offsets[v + 1] - 1], sorted and without duplicates or loops.
+ * Vertices are numbered in the order of the nodes they were built from.
+ */
+class CompactGraph
+{
+public:
+    typedef QPair<int, int> EdgePair;
+
+    // Without any vertices.
+    CompactGraph();
+    CompactGraph(const QVector<Node*> &nodes);
+    CompactGraph(int vertexCount, const QVector<EdgePair> &edges);
+
+    int vertexCount() const;
+    // Each undirected edge is counted once.
+    int edgeCount() const;
+    int degree(int v) const;
+    // Binary searches u's neighbours for v.
+    bool adjacent(int u, int v) const;
+
+    const int* neighboursBegin(int v) const;
+    const int* neighboursEnd(int v) const;
+
+private:
+    QVector<int> offsets;
+    QVector<int> targets;
+
+    void build(int vertexCount, const QVector<EdgePair> &edges);
+};
+
+
+/* The connected components of a CompactGraph, found by union-find over its
+ * edges and numbered from 0 in the order of their first vertices.
+ */
+class Components
+{
+public:
+    Components(const CompactGraph &graph);
+
+    int count() const;
+    int component(int v) const;
+    int size(int c) const;
+    // The largest component, the first of them on a tie, or -1 without
+    // any vertices.
+    int giant() const;
+    // Ordered pairs of distinct vertices with a path between them.
+    qint64 connectedPairs() const;
+
+private:
+    QVector<int> labels;
+    QVector<int> sizes;
+    int largest;
+};
+
+
+/* Breadth first search over a CompactGraph.  The distance, visited and
+ * queue arrays are allocated once and reused by every search; a vertex is
+ * visited in the current search if its stamp matches the generation.
+ */
+class BreadthFirst
+{
+public:
+    BreadthFirst(const CompactGraph &graph);
+
+    // Searches from the source, then returns the sum of the distances to
+    // every vertex reached, or the furthest of them.
+    qint64 distanceSum(int source);
+    int eccentricity(int source);
+
+    // Vertices reached by the last search, the source included, and their
+    // distance from it, or -1 for the others.
+    int reached() const;
+    int distance(int v) const;
+
+private:
+    const CompactGraph &graph;
+
+    QVector<int> distances;
+    QVector<unsigned int> stamps;
+    QVector<int> queue;
+    unsigned int generation;
+    int queueEnd;
+
+    void search(int source);
+};
+
+
+/* Brandes' dependencies of every vertex on a source: the shortest paths
+ * from the source through the vertex, each shared out evenly between the
+ * shortest paths to its end.  Summed over every source, they count each
+ * pair's paths twice towards the betweenness centrality.  The arrays are
+ * allocated once, and only the vertices reached are reset after a search.
+ */
+class Dependencies
+{
+public:
+    Dependencies(const CompactGraph &graph);
+
+    // Searches from the source and adds every other vertex's dependency on
+    // it to sums.
+    void accumulate(int source, QVector<double> &sums);
+
+private:
+    const CompactGraph &graph;
+
+    QVector<int> distances;
+    // The number of shortest paths from the source to each vertex
+    QVector<double> paths;
+    QVector<double> dependencies;
+    // The vertices reached, in the order they were
+    QVector<int> order;
+};
+
+
+/* The exact diameter and radius of a CompactGraph's largest component from
+ * a few breadth first searches on most real graphs.  A search from a vertex
+ * of eccentricity e bounds that of a vertex at distance d from it between
+ * max(d, e - d) and e + d, and the radius is found by searching alternately
+ * from the vertex with the highest upper bound and the one with the lowest
+ * lower bound, until every other vertex's lower bound reaches it (Takes and
+ * Kosters' BoundingDiameters).  The diameter is then found by iFUB: from a
+ * centre c, only a vertex on the fringe at distance i can be the end of a
+ * path longer than 2(i - 1), so searching from the fringes, furthest first
+ * and in parallel batches, stops once the longest path found is at least
+ * that.
+ */
+class DiameterBounds
+{
+public:
+    DiameterBounds(const CompactGraph &graph);
+    ~DiameterBounds();
+
+    // Both bounds have met.
+    bool isExact() const;
+    // Searches from one more vertex, or from a batch of the fringe on every
+    // thread.
+    void refine();
+
+    // Until exact, a lower bound on the diameter and an upper bound on the
+    // radius.
+    int diameter() const;
+    int radius() const;
+    // The vertices searched from.
+    int searches() const;
+
+private:
+    class FringeBatch;
+
+    const CompactGraph &graph;
+    BreadthFirst bfs;
+    // One for each fringe batch searched at once
+    QVector<BitParallelSearch*> fringeSearches;
+
+    // The largest component, and those of its vertices whose lower bound
+    // is still below the radius's upper bound.
+    QVector<int> giant;
+    QVector<int> remaining;
+    QVector<int> lower;
+    QVector<int> upper;
+    int diameterLow;
+    int diameterHigh;
+    int radiusLow;
+    int radiusHigh;
+    int searchCount;
+    bool highest;
+
+    // The largest component by distance from the centre, furthest first,
+    // the next of them to search from and the fringe it is on.
+    QVector<int> fringes;
+    QVector<int> centreDistances;
+    int nextFringe;
+    int fringe;
+
+    void searchForRadius();
+    void searchFringe();
+    void bound(int source, int eccentricity);
+    static void searchBatch(FringeBatch &batch);
+};
+
+
+/* Breadth first search from many sources at once.  Every vertex has a bit
+ * per source for whether the source has reached it, and a level of the
+ * search ORs the bits of each vertex's neighbours together, so one sweep
+ * over the edges advances all of the searches.  The words of a vertex are
+ * next to each other, so the ORs are wide vector operations.
+ */
+class BitParallelSearch
+{
+public:
+    static const int WORDS = 4;
+    static const int SOURCES = WORDS * 64;
+
+    BitParallelSearch(const CompactGraph &graph);
+
+    // Searches from the vertices first to first + count - 1, or from the
+    // given distinct vertices, at most SOURCES of them.
+    void search(int first, int count);
+    void search(const QVector<int> &sources);
+
+    // Over every source and every vertex it reached.
+    qint64 distanceSum() const;
+    // The pairs of a source and a vertex found at each distance.
+    const QVector<qint64>& distanceCounts() const;
+    // The furthest distance reached from the i-th source.
+    int eccentricity(int i) const;
+    int maxEccentricity() const;
+
+private:
+    const CompactGraph &graph;
+
+    QVector<quint64> seen;
+    QVector<quint64> frontier;
+    QVector<quint64> next;
+    QVector<int> eccentricities;
+    QVector<qint64> counts;
+};
+
+
+/* Counts the triangles through every vertex of a CompactGraph.  Each edge
+ * is directed from its end of lower degree to the other, ties going to the
+ * lower number, so every triangle is found exactly once, from its first
+ * vertex, and no vertex has more than sqrt(2m) out neighbours.  Out
+ * neighbour lists are intersected by merging them, except that a hub's are
+ * marked in an array and looked up.  The vertices are shared out between
+ * the threads in chunks.
+ */
+class TriangleCount
+{
+public:
+    // Out degree above which a vertex is intersected through the marks.
+    static const int HUB_DEGREE = 8;
+
+    TriangleCount(const CompactGraph &graph);
+
+    void count();
+
+    qint64 triangles() const;
+    qint64 triangles(int v) const;
+
+    // The fraction of the pairs of v's neighbours that are neighbours
+    // themselves, 0 below degree 2, and its average over every vertex.
+    double clustering(int v) const;
+    double clusteringAvg() const;
+    // Three times the triangles over the paths of length two.
+    double transitivity() const;
+
+private:
+    class Worker;
+
+    const CompactGraph &graph;
+
+    QVector<int> outOffsets;
+    QVector<int> outTargets;
+    QVector<QAtomicInt> counts;
+    qint64 total;
+
+    void orient();
+};
+
+
+/* Multiplies vectors by a CompactGraph's adjacency matrix, for power
+ * iteration.  The rows are cut into blocks, which the threads take one at a
+ * time, and the columns into bands narrow enough for their part of the
+ * vector to stay in cache.  Each row's neighbours are split up by band once,
+ * and a block is multiplied a band at a time, so its rows read the vector a
+ * quarter of a megabyte at a time instead of all over it.
+ */
+class AdjacencyProduct
+{
+public:
+    static const int BLOCK_ROWS = 4096;
+    static const int BAND_COLUMNS = 32768;
+
+    AdjacencyProduct(const CompactGraph &graph);
+
+    // Sets product[v] to the sum of vector[u] over v's neighbours u.
+    void multiply(const QVector<double> &vector, QVector<double> &product) const;
+
+private:
+    class Multiply;
+
+    int size;
+    // The neighbours of a block's rows in one band make up a segment, and
+    // a block's segments are ordered by band.  Block b's segments are
+    // blockStarts[b] to blockStarts[b + 1] - 1, and segment s's columns are
+    // columns[segmentStarts[s]] to columns[segmentStarts[s + 1] - 1].
+    QVector<int> blockStarts;
+    QVector<int> rows;
+    QVector<int> segmentStarts;
+    QVector<int> columns;
+};
+
+
+/* Communities of a CompactGraph by the Louvain method, which raises the
+ * modularity: the fraction of the edges within communities, less the
+ * fraction expected there if the edges were rewired at random keeping the
+ * degrees.  Every vertex starts in a community of its own, and sweeps of
+ * local moving put each vertex in the neighbouring community that raises
+ * the modularity most, until a sweep gains little.  The communities then become
+ * the vertices of a weighted graph, in compressed sparse row form, and the
+ * two phases repeat on it until nothing moves.  The threads take chunks of
+ * vertices and move them all at once, each seeing the others' moves as
+ * they are made, as in Staudt and Meyerhenke's PLM; the total degree of
+ * each community is kept atomically.
+ */
+class Communities
+{
+public:
+    Communities(const CompactGraph &graph);
+
+    // Moves the vertices of the current level and aggregates them into the
+    // next one.  Returns false once no more communities merged, when they
+    // are final.
+    bool refine();
+
+    // Numbered from 0, and exact for the levels refined so far.
+    int count() const;
+    int community(int v) const;
+    double modularity() const;
+    int levels() const;
+
+private:
+    class Mover;
+
+    const CompactGraph &graph;
+
+    // The graph of the current level, where the weight of an edge is the
+    // number of the original edges between its two communities, and the
+    // strength of a vertex the total degree of its community.
+    QVector<int> offsets;
+    QVector<int> targets;
+    QVector<int> weights;
+    QVector<int> strengths;
+    qint64 total;
+
+    // Of each vertex of the current level, and of each community its total
+    // strength
+    QVector<QAtomicInt> labels;
+    QVector<QAtomicInt> totals;
+    // Of each original vertex, its vertex in the current level
+    QVector<int> membership;
+    int levelCount;
+
+    void aggregate();
+};
+
+#endif // COMPACTGRAPH_H
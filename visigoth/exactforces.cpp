@@ -0,0 +1,111 @@
+#include "exactforces.h"
+
+// Keeps the kernel branch-free; negligible next to any real squared distance.
+static const float SOFTENING = 1e-6f;
+
+ExactForces::ExactForces(vreal strength) :
+    strength(strength)
+{
+}
+
+void ExactForces::build(const QVector<VPointF> &positions) {
+    const int n = positions.size();
+
+    xs.resize(n);
+    ys.resize(n);
+    zs.resize(n);
+    for (int i(0); i < n; ++i) {
+        xs[i] = positions[i].x;
+        ys[i] = positions[i].y;
+        zs[i] = positions[i].z;
+    }
+
+    fxs.fill(0.0f, n);
+    fys.fill(0.0f, n);
+    fzs.fill(0.0f, n);
+}
+
+void ExactForces::calculate() {
+    calculate(0, xs.size());
+}
+
+void ExactForces::calculate(int first, int count) {
+    const int n = xs.size();
+    const int end = first + count;
+    const float s = strength;
+
+    const float *x = xs.constData();
+    const float *y = ys.constData();
+    const float *z = zs.constData();
+
+    // The targets of a tile are copied into local buffers, which the compiler
+    // knows can't alias the sources.
+    float tx[TILE], ty[TILE], tz[TILE];
+    float fx[TILE], fy[TILE], fz[TILE];
+
+    // Stream every source past one tile of targets at a time.  The loop over
+    // the tile has no dependencies between iterations, so it vectorises.  A
+    // node's own contribution vanishes because its offset is zero, and the
+    // softening only keeps the division finite for it.
+    for (int tile(first); tile < end; tile += TILE) {
+        const int size = qMin((int) TILE, end - tile);
+
+        for (int i(0); i < size; ++i) {
+            tx[i] = x[tile + i];
+            ty[i] = y[tile + i];
+            tz[i] = z[tile + i];
+            fx[i] = fy[i] = fz[i] = 0.0f;
+        }
+
+        for (int j(0); j < n; ++j) {
+            const float xj = x[j];
+            const float yj = y[j];
+            const float zj = z[j];
+
+            for (int i(0); i < size; ++i) {
+                const float dx = tx[i] - xj;
+                const float dy = ty[i] - yj;
+                const float dz = tz[i] - zj;
+                const float l = dx * dx + dy * dy + dz * dz;
+                const float f = s / (l + SOFTENING);
+                fx[i] += dx * f;
+                fy[i] += dy * f;
+                fz[i] += dz * f;
+            }
+        }
+
+        for (int i(0); i < size; ++i) {
+            fxs[tile + i] = fx[i];
+            fys[tile + i] = fy[i];
+            fzs[tile + i] = fz[i];
+        }
+    }
+}
+
+VPointF ExactForces::force(int i) const {
+    return VPointF(fxs[i], fys[i], fzs[i]);
+}
+
+VPointD ExactForces::forceAt(const VPointD &p, int skip) const {
+    double fx = 0.0;
+    double fy = 0.0;
+    double fz = 0.0;
+
+    for (int j(0); j < xs.size(); ++j) {
+        if (j == skip) {
+            continue;
+        }
+
+        double dx = p.x - xs[j];
+        double dy = p.y - ys[j];
+        double dz = p.z - zs[j];
+        double l = dx * dx + dy * dy + dz * dz;
+        if (l > 0) {
+            fx += dx * strength / l;
+            fy += dy * strength / l;
+            fz += dz * strength / l;
+        }
+    }
+
+    return VPointD(fx, fy, fz);
+}
@@ -0,0 +1,47 @@
+#ifndef EXACTFORCES_H
+#define EXACTFORCES_H
+
+#include <QVector>
+
+#include "vtools.h"
+
+/* Exact all-pairs repulsion.  For small graphs the O(n^2) sum is cheaper
+ * than building a QuadTree and walking it, and it is the ground truth the
+ * approximations are measured against.  The positions are kept as separate
+ * float arrays and processed in tiles that stay in the L1 cache, so the
+ * inner loop can be vectorised by the compiler.
+ */
+class ExactForces
+{
+public:
+    ExactForces(vreal strength);
+
+    void build(const QVector<VPointF> &positions);
+    void calculate();
+
+    // Only the forces on positions first..first+count-1.
+    void calculate(int first, int count);
+
+    // The repulsion felt by the i-th position, after calculate().
+    VPointF force(int i) const;
+
+    // The repulsion felt at p from every position passed to build() but the
+    // skip-th, in double precision as the reference for the approximations.
+    // Positions equal to p are skipped too.
+    VPointD forceAt(const VPointD &p, int skip = -1) const;
+
+    // Below this many nodes the exact sum beats the QuadTree (see the
+    // crossover benchmark).
+    static const int CROSSOVER = 4000;
+
+private:
+    // Number of nodes whose forces are accumulated at once.
+    static const int TILE = 256;
+
+    vreal strength;
+
+    QVector<float> xs, ys, zs;
+    QVector<float> fxs, fys, fzs;
+};
+
+#endif // EXACTFORCES_H
@@ -0,0 +1,285 @@
+#include <QThread>
+#include <QtConcurrentMap>
+
+#include "fastmultipole.h"
+
+// Aim for this many independent subtrees per thread, to balance the load.
+static const int TASKS_PER_THREAD = 8;
+
+
+// ---------------------------------------------------------------------------
+// FastMultipole::Evaluate
+
+// Evaluates the repulsion on every body of one subtree.  Tasks only write to
+// the cells and bodies of their own subtree, so they can run concurrently.
+class FastMultipole::Evaluate {
+public:
+    typedef void result_type;
+
+    Evaluate(FastMultipole *fmm) :
+        fmm(fmm)
+    {
+    }
+
+    void operator()(Task &task) {
+        fmm->evaluate(task);
+    }
+
+private:
+    FastMultipole *fmm;
+};
+
+
+// ---------------------------------------------------------------------------
+// FastMultipole
+
+FastMultipole::FastMultipole(vreal strength, vreal tolerance) :
+    strength(strength),
+    tolerance(tolerance),
+    myInteractions(0)
+{
+}
+
+int FastMultipole::bodyCount() const {
+    return bodies.size();
+}
+
+QuadTree::TreeNode* FastMultipole::body(int i) const {
+    return bodies[i];
+}
+
+VPointF FastMultipole::force(int i) const {
+    return forces[i];
+}
+
+int FastMultipole::interactions() const {
+    return myInteractions;
+}
+
+void FastMultipole::calculate(const QuadTree &tree) {
+    cells.clear();
+    bodies.clear();
+    positions.clear();
+    myInteractions = 0;
+
+    if (tree.root().size() < 1) {
+        forces.clear();
+        return;
+    }
+
+    cells.resize(1);
+    flatten(&tree.root(), 0);
+    forces.fill(VPointF(0.0), bodies.size());
+
+    QVector<Task> tasks = splitTasks();
+    QtConcurrent::blockingMap(tasks, Evaluate(this));
+
+    foreach (const Task &task, tasks) {
+        myInteractions += task.interactions;
+    }
+}
+
+void FastMultipole::flatten(QuadTree::TreeNode *node, int index) {
+    cells[index].center = node->center();
+    cells[index].width = node->width();
+    cells[index].mass = node->size();
+    cells[index].quadrupole = node->quadrupole();
+    cells[index].firstBody = bodies.size();
+
+    QVector<QuadTree::TreeNode*> quadrants;
+    foreach (QuadTree::TreeNode *child, node->children()) {
+        if (child->size() < 1) {
+            continue;
+        }
+
+        // Graph nodes have no width, quadrants always do.
+        if (child->width() == 0) {
+            bodies << child;
+            positions << child->center();
+        } else {
+            quadrants << child;
+        }
+    }
+
+    int first = cells.size();
+    cells[index].firstChild = first;
+    cells[index].childCount = quadrants.size();
+    cells.resize(first + quadrants.size());
+    for (int i(0); i < quadrants.size(); ++i) {
+        flatten(quadrants[i], first + i);
+    }
+
+    cells[index].bodyCount = bodies.size() - cells[index].firstBody;
+}
+
+QVector<FastMultipole::Task> FastMultipole::splitTasks() const {
+    const int wanted = TASKS_PER_THREAD * QThread::idealThreadCount();
+
+    QVector<int> tasks;
+    tasks << 0;
+
+    bool split = true;
+    while (split && tasks.size() < wanted) {
+        split = false;
+
+        QVector<int> next;
+        foreach (int task, tasks) {
+            const Cell &cell = cells[task];
+            if (cell.isLeaf()) {
+                next << task;
+            } else {
+                for (int c(0); c < cell.childCount; ++c) {
+                    next << cell.firstChild + c;
+                }
+                split = true;
+            }
+        }
+        tasks = next;
+    }
+
+    QVector<Task> result;
+    foreach (int cell, tasks) {
+        result << Task(cell);
+    }
+    return result;
+}
+
+void FastMultipole::evaluate(Task &task) {
+    // The whole tree acts on the subtree, which then passes its expansions
+    // down to its nodes.
+    interact(task.cell, 0, task.interactions);
+    pushDown(task.cell);
+}
+
+void FastMultipole::interact(int target, int source, int &interactions) {
+    Cell &t = cells[target];
+    const Cell &s = cells.at(source);
+
+    if (target != source) {
+        VPointF r = t.center - s.center;
+        vreal distance = r.length();
+        if (distance > 0 && (t.width + s.width) < tolerance * distance) {
+            cellToCell(t, s);
+            ++interactions;
+            return;
+        }
+    }
+
+    if (t.isLeaf() && s.isLeaf()) {
+        bodyToBody(t, s);
+        interactions += t.bodyCount * s.bodyCount;
+        return;
+    }
+
+    // Split the larger of the two cells
+    if (s.isLeaf() || (!t.isLeaf() && t.width >= s.width)) {
+        for (int c(0); c < t.childCount; ++c) {
+            interact(t.firstChild + c, source, interactions);
+        }
+    } else {
+        for (int c(0); c < s.childCount; ++c) {
+            interact(target, s.firstChild + c, interactions);
+        }
+    }
+}
+
+void FastMultipole::cellToCell(Cell &target, const Cell &source) {
+    VPointF r = target.center - source.center;
+    vreal l = r.lengthSquared();
+
+    target.field = target.field +
+        (r * (source.mass / l) + source.quadrupole.force(r)) * strength;
+
+    // Gradient of the monopole field m r / |r|^2
+    vreal a = strength * source.mass / l;
+    vreal b = 2 * a / l;
+    target.xx += a - b * r.x * r.x;
+    target.yy += a - b * r.y * r.y;
+    target.zz += a - b * r.z * r.z;
+    target.xy -= b * r.x * r.y;
+    target.xz -= b * r.x * r.z;
+    target.yz -= b * r.y * r.z;
+}
+
+void FastMultipole::bodyToBody(const Cell &target, const Cell &source) {
+    const int sourceEnd = source.firstBody + source.bodyCount;
+
+    for (int i = target.firstBody; i < target.firstBody + target.bodyCount; ++i) {
+        const VPointF p = positions[i];
+        VPointF vel = VPointF(0.0);
+
+        for (int j = source.firstBody; j < sourceEnd; ++j) {
+            VPointF vec = p - positions[j];
+            vreal l = vec.lengthSquared();
+            if (l > 0) {
+                vel = vel + vec * (strength / l);
+            }
+        }
+
+        forces[i] = forces[i] + vel;
+    }
+}
+
+void FastMultipole::pushDown(int target) {
+    const Cell &t = cells[target];
+
+    if (t.isLeaf()) {
+        for (int i = t.firstBody; i < t.firstBody + t.bodyCount; ++i) {
+            VPointF d = positions[i] - t.center;
+            forces[i] = forces[i] + t.field +
+                VPointF(t.xx * d.x + t.xy * d.y + t.xz * d.z,
+                        t.xy * d.x + t.yy * d.y + t.yz * d.z,
+                        t.xz * d.x + t.yz * d.y + t.zz * d.z);
+        }
+        return;
+    }
+
+    for (int c(0); c < t.childCount; ++c) {
+        Cell &child = cells[t.firstChild + c];
+        VPointF d = child.center - t.center;
+
+        child.field = child.field + t.field +
+            VPointF(t.xx * d.x + t.xy * d.y + t.xz * d.z,
+                    t.xy * d.x + t.yy * d.y + t.yz * d.z,
+                    t.xz * d.x + t.yz * d.y + t.zz * d.z);
+        child.xx += t.xx;
+        child.yy += t.yy;
+        child.zz += t.zz;
+        child.xy += t.xy;
+        child.xz += t.xz;
+        child.yz += t.yz;
+
+        pushDown(t.firstChild + c);
+    }
+}
+
+
+// ---------------------------------------------------------------------------
+// FastMultipole::Cell
+
+FastMultipole::Cell::Cell() :
+    center(0.0),
+    width(0.0),
+    mass(0),
+    firstChild(0),
+    childCount(0),
+    firstBody(0),
+    bodyCount(0),
+    field(0.0),
+    xx(0.0), yy(0.0), zz(0.0), xy(0.0), xz(0.0), yz(0.0)
+{
+}
+
+bool FastMultipole::Cell::isLeaf() const {
+    return childCount == 0;
+}
+
+
+// ---------------------------------------------------------------------------
+// FastMultipole::Task
+
+FastMultipole::Task::Task(int cell) :
+    cell(cell),
+    interactions(0)
+{
+}
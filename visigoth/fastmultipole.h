@@ -0,0 +1,95 @@
+#ifndef FASTMULTIPOLE_H
+#define FASTMULTIPOLE_H
+
+#include <QVector>
+
+#include "vtools.h"
+#include "quadtree.h"
+
+/* Fast multipole repulsion over a built QuadTree.  Instead of every node
+ * walking the tree, pairs of cells that are far enough from each other
+ * interact once: the multipoles of the source cell are turned into a local
+ * (first order Taylor) expansion of the field around the target cell, which
+ * a downward pass then pushes into the cell's children and finally its
+ * nodes.  Only neighbouring leaves are summed node by node.  This takes O(n)
+ * per frame, and the subtrees are evaluated in parallel.
+ *
+ * The tree is flattened into arrays first, so the traversal doesn't go
+ * through the virtual TreeNode interface.
+ */
+class FastMultipole
+{
+public:
+    FastMultipole(vreal strength, vreal tolerance = DEFAULT_TOLERANCE);
+
+    void calculate(const QuadTree &tree);
+
+    // The graph nodes in the tree, and the repulsion they feel.
+    int bodyCount() const;
+    QuadTree::TreeNode* body(int i) const;
+    VPointF force(int i) const;
+
+    // Cell pairs and node pairs evaluated by the last calculate().
+    int interactions() const;
+
+    // Two cells interact directly if the sum of their widths over their
+    // distance is under the tolerance.
+    static const vreal DEFAULT_TOLERANCE = 0.5;
+
+private:
+    class Evaluate;
+    friend class Evaluate;
+
+    // A subtree evaluated by one thread.
+    class Task {
+    public:
+        Task(int cell = 0);
+
+        int cell;
+        int interactions;
+    };
+
+    class Cell {
+    public:
+        Cell();
+
+        VPointF center;
+        vreal width;
+        int mass;
+        QuadTree::Quadrupole quadrupole;
+
+        // Children are stored next to each other, as are the bodies of the
+        // whole subtree.
+        int firstChild;
+        int childCount;
+        int firstBody;
+        int bodyCount;
+
+        // The local expansion: the field at the center and its gradient,
+        // which is symmetric.
+        VPointF field;
+        vreal xx, yy, zz, xy, xz, yz;
+
+        bool isLeaf() const;
+    };
+
+    vreal strength;
+    vreal tolerance;
+    int myInteractions;
+
+    QVector<Cell> cells;
+    QVector<QuadTree::TreeNode*> bodies;
+    QVector<VPointF> positions;
+    QVector<VPointF> forces;
+
+    void flatten(QuadTree::TreeNode *node, int index);
+    QVector<Task> splitTasks() const;
+
+    void evaluate(Task &task);
+    void interact(int target, int source, int &interactions);
+    void cellToCell(Cell &target, const Cell &source);
+    void bodyToBody(const Cell &target, const Cell &source);
+    void pushDown(int target);
+};
+
+#endif // FASTMULTIPOLE_H
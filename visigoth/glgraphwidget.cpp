@@ -1,5 +1,7 @@
 #include <QMouseEvent>
 #include <QKeyEvent>
+#include <QStringList>
+#include <QTimerEvent>
 #include <cmath>
 
 #ifdef __APPLE__
@@ -14,7 +16,26 @@
 #include "edge.h"
 #include "node.h"
 #include "quadtree.h"
+#include "statistics.h"
 
+// RMS error of the repulsion the adaptive tolerance aims for.
+static const qreal TARGET_ERROR = 0.02;
+
+// Milliseconds of layout per frame when budgeted, under the 40 ms between
+// animation frames.
+static const qreal FRAME_BUDGET = 20.0;
+
+// Frames and layout steps per second.
+static const int DISPLAY_RATE = 60;
+static const int DEFAULT_SIMULATION_RATE = 25;
+static const int MIN_SIMULATION_RATE = 1;
+static const int MAX_SIMULATION_RATE = 100;
+
+// Nodes this many hops from a dragged node follow it.
+static const int DRAG_HOPS = 2;
+
+// The most central node is drawn this many times its usual size.
+static const float CENTRALITY_SCALE = 4.0;
 
 /****************************
  * GraphWidget imitation code (public)
@@ -24,7 +45,16 @@ GLGraphWidget::GLGraphWidget(QWidget *parent) :
     QGLWidget(parent),
     myScene(0),
     mouseMode(MOUSE_IDLE),
-    animTimerId(0)
+    draggedNode(0),
+    animatedBeforeDrag(false),
+    animTimerId(0),
+    showCentrality(false),
+    showCommunities(false),
+    minimumCore(0),
+    coreVersion(0),
+    displayTimerId(0),
+    mySimulationRate(DEFAULT_SIMULATION_RATE),
+    displayAlpha(1.0)
 {
     setFocusPolicy(Qt::StrongFocus);
     setMouseTracking(true);
@@ -62,13 +92,37 @@ bool GLGraphWidget::animationRunning() {
 
 void GLGraphWidget::setAnimation(bool enable) {
     if (enable && !animTimerId) {
-        animTimerId = startTimer(1000 / 25);
+        animTimerId = startTimer(1000 / mySimulationRate);
+        if (!displayTimerId) {
+            displayTimerId = startTimer(1000 / DISPLAY_RATE);
+        }
     } else if (!enable && animTimerId) {
+        // The display timer stops once it has caught up with the layout.
         killTimer(animTimerId);
         animTimerId = 0;
     }
 }
 
+int GLGraphWidget::simulationRate() const {
+    return mySimulationRate;
+}
+
+void GLGraphWidget::setSimulationRate(int rate) {
+    mySimulationRate = qBound(MIN_SIMULATION_RATE, rate, MAX_SIMULATION_RATE);
+
+    if (animTimerId) {
+        killTimer(animTimerId);
+        animTimerId = startTimer(1000 / mySimulationRate);
+    }
+}
+
+qreal GLGraphWidget::interpolation() const {
+    if (!sinceStep.isValid()) {
+        return 1.0;
+    }
+    return qMin((qreal) 1.0, sinceStep.elapsed() * mySimulationRate / (qreal) 1000.0);
+}
+
 void GLGraphWidget::onNodeMoved() {
     setAnimation(true);
 }
@@ -134,10 +188,14 @@ void GLGraphWidget::mousePressEvent(QMouseEvent *event) {
                     // Calculate stats
                     emit onSelectNode(hitNode);
 
-                    // Set up dragging
+                    // Set up dragging.  Only the neighbourhood of the
+                    // node is laid out until it is let go.
                     draggedNode = hitNode;
                     draggedNode->setAllowAdvance(false);
                     mouseMode = MOUSE_DRAGGING;
+                    animatedBeforeDrag = animationRunning();
+                    setAnimation(false);
+                    myScene->beginRelaxing(draggedNode, DRAG_HOPS);
                 } else {
                     if (mode3d)
                         mouseMode = MOUSE_TRANSLATING_XY;
@@ -164,8 +222,11 @@ void GLGraphWidget::mousePressEvent(QMouseEvent *event) {
 void GLGraphWidget::mouseReleaseEvent(QMouseEvent *event) {
     (void) event;
 
-    if (mouseMode == MOUSE_DRAGGING && draggedNode)
-      draggedNode->setAllowAdvance(true);
+    if (mouseMode == MOUSE_DRAGGING && draggedNode) {
+        myScene->endRelaxing();
+        draggedNode->setAllowAdvance(true);
+        setAnimation(animatedBeforeDrag);
+    }
 
     mouseMode = MOUSE_IDLE;
 }
@@ -222,7 +283,8 @@ void GLGraphWidget::mouseMoveEvent(QMouseEvent *event) {
                         model, proj, viewmat,
                         &newX, &newY, &newZ);
 
-            draggedNode->setPos(VPointF(newX, newY, newZ));
+            draggedNode->setPos(VPointF(newX, newY, newZ), true);
+            myScene->relaxAround();
             break;
         }
         default:
@@ -257,6 +319,46 @@ void GLGraphWidget::keyPressEvent(QKeyEvent *event) {
     case Qt::Key_N:
         myScene->addVertex();
         break;
+    case Qt::Key_I:
+        myScene->setInstrumented(!myScene->instrumented());
+        break;
+    case Qt::Key_T:
+        if (myScene->targetError() > 0) {
+            myScene->setTargetError(0.0);
+            myScene->setTolerance(myScene->defaultTolerance());
+        } else {
+            myScene->setTargetError(TARGET_ERROR);
+        }
+        setAnimation(true);
+        break;
+    case Qt::Key_Q:
+        myScene->setQuadrupoles(!myScene->quadrupoles());
+        setAnimation(true);
+        break;
+    case Qt::Key_B:
+        myScene->setFrameBudget(myScene->frameBudget() > 0 ? 0.0 : FRAME_BUDGET);
+        setAnimation(true);
+        break;
+    case Qt::Key_C:
+        showCentrality = !showCentrality;
+        emit centralityToggled(showCentrality);
+        break;
+    case Qt::Key_M:
+        showCommunities = !showCommunities;
+        emit communitiesToggled(showCommunities);
+        break;
+    case Qt::Key_K:
+        minimumCore = qMin(minimumCore + 1, myScene->getStatistics()->maxCore());
+        break;
+    case Qt::Key_J:
+        minimumCore = qMax(minimumCore - 1, 0);
+        break;
+    case Qt::Key_BracketLeft:
+        setSimulationRate(mySimulationRate / 2);
+        break;
+    case Qt::Key_BracketRight:
+        setSimulationRate(mySimulationRate * 2);
+        break;
     case Qt::Key_Right:
         glaCameraTranslatef(cameramat, (-20.0)/zoom, 0.0, 0.0);
         break;
@@ -276,16 +378,24 @@ void GLGraphWidget::keyPressEvent(QKeyEvent *event) {
     this->repaint();
 }
 
-void GLGraphWidget::timerEvent(QTimerEvent *) {
-    bool somethingMoved = myScene->calculateForces();
+void GLGraphWidget::timerEvent(QTimerEvent *event) {
+    if (event->timerId() == animTimerId) {
+        bool somethingMoved = myScene->calculateForces();
+        sinceStep.restart();
 
-    if (!somethingMoved) {
-        // setAnimation(true) would recreate the timer though it is
-        // already running (this is a timer event). So don't do it.
-        setAnimation(false);
-    }
+        if (!somethingMoved) {
+            // setAnimation(true) would recreate the timer though it is
+            // already running (this is a timer event). So don't do it.
+            setAnimation(false);
+        }
+    } else if (event->timerId() == displayTimerId) {
+        if (!animTimerId && interpolation() >= 1.0) {
+            killTimer(displayTimerId);
+            displayTimerId = 0;
+        }
 
-    this->repaint();
+        this->repaint();
+    }
 }
 
 
@@ -325,6 +435,7 @@ void GLGraphWidget::paintGL() {
     drawBackground();
 
     // Draw the graph and the central box
+    displayAlpha = interpolation();
     initGraphProjection();
     glaDrawExample();
     drawGraphGL();
@@ -358,6 +469,42 @@ void GLGraphWidget::drawBackground() {
 }
 
 void GLGraphWidget::drawOverlay() {
+    const GraphScene::LayoutStats &stats = myScene->layoutStats();
+
+    QStringList lines;
+    if (myScene->instrumented()) {
+        lines << QString("%1 ms/frame at %9 Hz  %2 interactions  tolerance %3%4  "
+                         "error rms %5 max %6 (%7 samples, %8 ms)")
+            .arg(stats.frameTime, 0, 'f', 1)
+            .arg(stats.interactions)
+            .arg(stats.tolerance, 0, 'f', 2)
+            .arg(myScene->quadrupoles() ? " quadrupoles" : "")
+            .arg(stats.rmsError, 0, 'g', 2)
+            .arg(stats.maxError, 0, 'g', 2)
+            .arg(stats.samples)
+            .arg(stats.samplingTime, 0, 'f', 1)
+            .arg(mySimulationRate);
+    }
+    if (myScene->budgeted()) {
+        lines << QString("budget %1 ms/frame  %2% of the nodes moved")
+            .arg(myScene->frameBudget(), 0, 'f', 0)
+            .arg(100 * stats.completed, 0, 'f', 0);
+    } else if (myScene->frameBudget() > 0) {
+        lines << QString("budget %1 ms/frame  not used by the fast multipole method")
+            .arg(myScene->frameBudget(), 0, 'f', 0);
+    }
+    if (minimumCore > 0) {
+        lines << QString("%1-core and up of %2")
+            .arg(minimumCore)
+            .arg(myScene->getStatistics()->maxCore());
+    }
+
+    // Readable whatever the background
+    QColor c = myScene->backgroundColour();
+    glColor4f(1.0 - c.redF(), 1.0 - c.greenF(), 1.0 - c.blueF(), 1.0);
+    for (int i(0); i < lines.size(); ++i) {
+        renderText(10, 20 * (i + 1), lines[i]);
+    }
 }
 
 
@@ -398,11 +545,17 @@ inline void GLGraphWidget::drawCircle(GLfloat r, int longs) {
 }
 
 inline void GLGraphWidget::drawNode(Node *node) {
-    const QColor c = node->highlighted() ? Qt::red : node->colour();
-    glColor4f(c.redF(), c.greenF(), c.blueF(), c.alphaF());
-
+    QColor c = node->highlighted() ? Qt::red : node->colour();
     float radius = (log(node->edges().size()) / log(2)) + 1.0;
-    VPointF p = node->pos();
+    if (showCentrality) {
+        // From blue for the least central to red for the most
+        if (!node->highlighted()) {
+            c = QColor::fromHsvF((1.0 - node->centrality()) * 2.0 / 3.0, 1.0, 1.0, c.alphaF());
+        }
+        radius *= 1.0 + (CENTRALITY_SCALE - 1.0) * node->centrality();
+    }
+    glColor4f(c.redF(), c.greenF(), c.blueF(), c.alphaF());
+    VPointF p = node->displayPos(displayAlpha);
 
     glPushMatrix();
         glTranslatef(p.x, p.y, p.z);
@@ -416,25 +569,47 @@ inline void GLGraphWidget::drawNode(Node *node) {
 }
 
 void GLGraphWidget::drawGraphGL() {
+    updateCores();
+
     // Draw edges
     foreach (Edge* edge, myScene->edges()) {
+        if (!isShown(edge->sourceNode()) || !isShown(edge->destNode()))
+            continue;
         const QColor c = edge->highlighted() ? Qt::yellow : edge->colour();
         glColor4f(c.redF(), c.greenF(), c.blueF(), c.alphaF());
 
         glBegin(GL_LINE_STRIP);
-            VPointF p = edge->sourceNode()->pos();
-            glVertex3f((GLfloat)p.x, (GLfloat)p.y, (GLfloat)p.z);
-            p = edge->destNode()->pos();
-            glVertex3f((GLfloat)p.x, (GLfloat)p.y, (GLfloat)p.z);
+            VPointF p = edge->sourceNode()->displayPos(displayAlpha);
+            glVertex3f(p.x, p.y, p.z);
+            p = edge->destNode()->displayPos(displayAlpha);
+            glVertex3f(p.x, p.y, p.z);
         glEnd();
     }
 
     // Draw nodes
     foreach (Node* node, myScene->nodes()) {
-        drawNode(node);
+        if (isShown(node))
+            drawNode(node);
     }
 }
 
+inline bool GLGraphWidget::isShown(Node *node) const {
+    return node->core() >= minimumCore;
+}
+
+// The core numbers only change with the graph, in linear time.
+void GLGraphWidget::updateCores() {
+    if (minimumCore == 0 || coreVersion == myScene->version())
+        return;
+
+    const QVector<int> &cores = myScene->getStatistics()->coreNumbers();
+    QVector<Node*> &nodes = myScene->nodes();
+    for (int i(0); i < nodes.size(); ++i) {
+        nodes[i]->setCore(cores[i]);
+    }
+    coreVersion = myScene->version();
+}
+
 
 /*** Projection setup ***/
 
@@ -528,6 +703,9 @@ Node* GLGraphWidget::selectGL(int x, int y)
 
     QVector<Node*> &nodes = myScene->nodes();
     for (int i = nodes.size() - 1; i >= 0; --i) {
+        if (!isShown(nodes[i]))
+            continue;
+
         glSelectBuffer(64, namebuf);
         glRenderMode(GL_SELECT);
 
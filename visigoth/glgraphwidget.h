@@ -2,6 +2,7 @@
 #define GLGRAPHWIDGET_H
 
 #include <QGLWidget>
+#include <QElapsedTimer>
 #include <QList>
 
 class GraphScene;
@@ -21,6 +22,10 @@ public:
     void setScene(GraphScene *newScene);
     void resetHighlighting();
 
+    // Layout steps per second, independent of the display refresh rate.
+    int simulationRate() const;
+    void setSimulationRate(int rate);
+
     enum MOUSE_MODES {
         MOUSE_IDLE,
         MOUSE_ROTATING,
@@ -33,6 +38,8 @@ public:
 signals:
     void algorithmChanged(Algorithm *newAlgo);
     void onSelectNode(Node *node);
+    void centralityToggled(bool shown);
+    void communitiesToggled(bool shown);
 
 protected:
     bool animationRunning();
@@ -66,6 +73,9 @@ private:
     void drawCircle(GLfloat r, int longs);
     void drawNode(Node *node);
     void drawGraphGL();
+    // Whether the node is in the core being shown.
+    bool isShown(Node *node) const;
+    void updateCores();
 
     void initGraphProjection();
     void initOverlayProjection();
@@ -74,6 +84,8 @@ private:
 
     Node *selectGL(int x, int y);
 
+    qreal interpolation() const;
+
     GraphScene *myScene;
     GLfloat cameramat[16];
     GLfloat projmat[16];
@@ -82,10 +94,27 @@ private:
     int mouseX, mouseY;
     enum MOUSE_MODES mouseMode;
     Node *draggedNode;
+    // Whether the layout was running when the drag started.
+    bool animatedBeforeDrag;
 
     bool mode3d;
     bool running;
     int animTimerId;
+    // Nodes are drawn by their centrality rather than their colour.
+    bool showCentrality;
+    // Nodes are coloured by their community.
+    bool showCommunities;
+    // Only the nodes with this core number or higher are drawn, their cores
+    // as of the given version of the scene.
+    int minimumCore;
+    quint64 coreVersion;
+
+    // The display timer redraws the nodes between their positions before
+    // and after the last layout step.
+    int displayTimerId;
+    int mySimulationRate;
+    QElapsedTimer sinceStep;
+    qreal displayAlpha;
 };
 
 #endif // GLGRAPHWIDGET_H
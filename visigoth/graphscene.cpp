@@ -7,16 +7,46 @@
 #include "statistics.h"
 #include "barabasialbert.h"
 #include "wattsstrogatz.h"
+#include "spatialgrid.h"
+#include "exactforces.h"
+#include "fastmultipole.h"
 #ifdef HAS_OAUTH
 #include "twitter.h"
 #endif
 
+#include <QElapsedTimer>
+#include <cmath>
+
+// Nodes whose QuadTree repulsion is checked every frame when instrumented.
+static const int ERROR_SAMPLES = 32;
+
+// Bounds and step of the adaptive tolerance.
+static const vreal MIN_TOLERANCE = 0.1;
+static const vreal MAX_TOLERANCE = 2.0;
+static const vreal TOLERANCE_STEP = 1.1;
+
+// Nodes moved between two looks at the clock in a budgeted frame.
+static const int BUDGET_CHECK = 64;
+
+// Most nodes relaxed by relaxAround(), so hubs stay cheap to drag.
+static const int MAX_RELAXED = 2000;
+
 GraphScene::GraphScene(QObject *parent) :
     QObject(parent),
     algo(0),
+    myVersion(0),
     degreeCount(1),
     myBackgroundColour(Qt::black),
     mode3d(false),
+    myRepulsionMode(REPULSION_AUTO),
+    isInstrumented(false),
+    useQuadrupoles(true),
+    myTolerance(QuadTree::TreeNode::quadrupoleTolerance),
+    myTargetError(0.0),
+    myFrameBudget(0.0),
+    mySliceStart(0),
+    sweepMoved(false),
+    myFrozenTree(0),
     myEdgeColour(QColor::fromRgbF(0.0, 0.0, 1.0, 0.5)),
     myNodeColour(QColor::fromRgbF(0.0, 1.0, 0.3, 0.7))
 {
@@ -30,6 +60,7 @@ GraphScene::GraphScene(QObject *parent) :
 }
 
 GraphScene::~GraphScene() {
+    delete myFrozenTree;
     delete stats;
 }
 
@@ -47,6 +78,7 @@ void GraphScene::onNodeMoved() {
 
 void GraphScene::reset() {
     //clear();
+    endRelaxing();
     hasEdge.clear();
     myEdges.clear();
     foreach (Node *node, myNodes) {
@@ -56,6 +88,9 @@ void GraphScene::reset() {
     degreeCount.clear();
     Node::reset();
     //FIXME also free nodes and edges
+
+    ++myVersion;
+    emit cleared();
 }
 
 QVector<Node*>& GraphScene::nodes() {
@@ -105,6 +140,9 @@ bool GraphScene::newEdge(Node *source, Node *dest) {
     updateDegreeCount(source);
     updateDegreeCount(dest);
 
+    ++myVersion;
+    emit edgeAdded(source, dest);
+
     return true;
 }
 
@@ -126,36 +164,38 @@ Node* GraphScene::newNode() {
     connect(node, SIGNAL(nodeMoved()), this, SLOT(onNodeMoved()));
     onNodeMoved();
 
-    return node;
-}
-
-// Pre: Will remove nodes staring from last node in list
-void GraphScene::removeNode(Node *n) {
-    myNodes.remove(n->tag());
-}
+    ++myVersion;
+    emit nodeAdded(node);
 
-// CutoffTag is for destNodes only!
-void GraphScene::removeEdges(int cutoffTag) {
-    for (int i(0); i < myEdges.size(); ++i) {
-        if (myEdges[i]->destNode()->tag() >= cutoffTag) {
-            myEdges.removeAt(i);
-            // just to make sure nothing is skipped
-            --i;
-        }
-    }
+    return node;
 }
 
 // used in Watts Strogatz
 void GraphScene::removeEdge(Node * source, Node* dst){
     for(int i(0); i < myEdges.size(); ++i){
-        if(myEdges[i]->sourceNode()->tag() == source->tag() &&
-            myEdges[i]->destNode()->tag() == dst->tag()){
+        Edge *edge = myEdges[i];
+        if((edge->sourceNode() == source && edge->destNode() == dst) ||
+           (edge->sourceNode() == dst && edge->destNode() == source)){
             myEdges.removeAt(i);
-            --i;
+            source->removeEdge(edge);
+            dst->removeEdge(edge);
+            hasEdge[source->tag()].remove(dst->tag());
+            hasEdge[dst->tag()].remove(source->tag());
+            degreeDecrease(source);
+            degreeDecrease(dst);
+            delete edge;
+
+            ++myVersion;
+            emit edgeRemoved(source, dst);
+            return;
         }
     }
 }
 
+quint64 GraphScene::version() const {
+    return myVersion;
+}
+
 bool GraphScene::doesEdgeExist(Node *source, Node *dest) const {
     int sourceTag = source->tag();
     int destTag = dest->tag();
@@ -221,25 +261,9 @@ void GraphScene::repopulate() {
 #endif
         }
     }
+    // The generators hit their target degree distributions by themselves,
+    // see BarabasiAlbert::attractiveness().
     algo->reset();
-    int counter = 0;
-    if(algo->getSWNFlag()){
-        if(!stats) {
-            stats = new Statistics(this);
-        }
-        // Cutoff value exsists because for low max degree
-        // generating a reasonable exponent is not possible
-        double exponent = stats->powerLawExponent();
-        while((exponent > 4.0 ||
-              exponent < 2.1 ) &&
-              (counter < 200))
-        {
-            reset();
-            algo->reset();
-            exponent = stats->powerLawExponent();
-            ++counter;
-        }
-    }
     randomizePlacement();
 
     emit repopulated();
@@ -285,13 +309,204 @@ void GraphScene::updateDegreeCount(Node *node) {
          degreeRemove(node);
 }
 
+GraphScene::REPULSION_MODES GraphScene::repulsionMode() const {
+    return myRepulsionMode;
+}
+
+void GraphScene::setRepulsionMode(REPULSION_MODES mode) {
+    myRepulsionMode = mode;
+}
+
+const GraphScene::LayoutStats& GraphScene::layoutStats() const {
+    return myLayoutStats;
+}
+
+bool GraphScene::instrumented() const {
+    return isInstrumented;
+}
+
+void GraphScene::setInstrumented(bool enabled) {
+    isInstrumented = enabled;
+}
+
+vreal GraphScene::tolerance() const {
+    return myTolerance;
+}
+
+void GraphScene::setTolerance(vreal newTolerance) {
+    myTolerance = newTolerance;
+}
+
+vreal GraphScene::defaultTolerance() const {
+    if (useQuadrupoles) {
+        return QuadTree::TreeNode::quadrupoleTolerance;
+    }
+    return QuadTree::TreeNode::tolerance;
+}
+
+bool GraphScene::quadrupoles() const {
+    return useQuadrupoles;
+}
+
+void GraphScene::setQuadrupoles(bool enabled) {
+    useQuadrupoles = enabled;
+    myTolerance = defaultTolerance();
+}
+
+qreal GraphScene::targetError() const {
+    return myTargetError;
+}
+
+void GraphScene::setTargetError(qreal error) {
+    myTargetError = error;
+}
+
+qreal GraphScene::frameBudget() const {
+    return myFrameBudget;
+}
+
+void GraphScene::setFrameBudget(qreal milliseconds) {
+    myFrameBudget = milliseconds;
+    sweepMoved = false;
+}
+
+bool GraphScene::budgeted() const {
+    return myFrameBudget > 0 && myRepulsionMode != REPULSION_FMM;
+}
+
 bool GraphScene::calculateForces() {
+    QElapsedTimer timer;
+    timer.start();
+    myLayoutStats = LayoutStats();
+
+    bool sweepDone = true;
+    if (budgeted()) {
+        sweepDone = calculateBudgetedForces(timer);
+    } else {
+        switch (activeRepulsionMode()) {
+        case REPULSION_AUTO:
+        case REPULSION_QUADTREE:
+            calculateTreeForces();
+            break;
+        case REPULSION_GRID:
+            calculateGridForces();
+            break;
+        case REPULSION_EXACT:
+            calculateExactForces();
+            break;
+        case REPULSION_FMM:
+            calculateFmmForces();
+            break;
+        }
+    }
+
+    bool somethingMoved = false;
+    foreach (Node *node, nodes()) {
+        if (node->advance()) {
+            somethingMoved = true;
+        }
+    }
+
+    myLayoutStats.frameTime = timer.nsecsElapsed() / 1e6 - myLayoutStats.samplingTime;
+
+    // A budgeted layout has only settled if nothing moved during a whole
+    // sweep over the nodes.
+    if (budgeted()) {
+        sweepMoved = sweepMoved || somethingMoved;
+        if (!sweepDone) {
+            return true;
+        }
+        somethingMoved = sweepMoved;
+        sweepMoved = false;
+    }
+
+    return somethingMoved;
+}
+
+void GraphScene::beginRelaxing(Node *center, int hops) {
+    endRelaxing();
+
+    // Breadth first out to the nodes that move.  Their edges pull them
+    // whether or not the other end moves too.
+    QSet<Node*> seen;
+    myRelaxed << center;
+    seen << center;
+
+    int frontier = 0;
+    for (int hop(0); hop < hops && frontier < myRelaxed.size(); ++hop) {
+        int end = myRelaxed.size();
+        for (int i = frontier; i < end && myRelaxed.size() < MAX_RELAXED; ++i) {
+            foreach (Node *neighbour, myRelaxed[i]->neighbours()) {
+                if (!seen.contains(neighbour) && myRelaxed.size() < MAX_RELAXED) {
+                    seen << neighbour;
+                    myRelaxed << neighbour;
+                }
+            }
+        }
+        frontier = end;
+    }
+
+    // The rest of the graph stays where it is for the whole drag, so its
+    // repulsion comes from one QuadTree built now.  Without it dragged
+    // clusters would collapse into the nodes around them.
+    myFrozenTree = new QuadTree(graphCube().longestEdge());
+    foreach (Node *node, myNodes) {
+        if (!seen.contains(node)) {
+            myFrozenTree->addNode(node);
+        }
+    }
+    if (useQuadrupoles) {
+        myFrozenTree->computeQuadrupoles();
+    }
+}
+
+void GraphScene::relaxAround() {
+    if (!myFrozenTree) {
+        return;
+    }
+
+    // There are few enough relaxed nodes to sum their repulsion exactly.
+    QVector<VPointF> positions(myRelaxed.size());
+    for (int i(0); i < myRelaxed.size(); ++i) {
+        positions[i] = myRelaxed[i]->pos();
+    }
+    ExactForces exact(Node::REPULSION);
+    exact.build(positions);
+    exact.calculate();
+
+    // Don't move the first node
+    int interactions = 0;
+    for (int i(1); i < myRelaxed.size(); ++i) {
+        Node *node = myRelaxed[i];
+        if (node != myNodes[0]) {
+            node->calculatePosition(exact.force(i) +
+                                    node->calculateRepulsion(myFrozenTree->root(), myTolerance, interactions));
+        }
+    }
+    for (int i(1); i < myRelaxed.size(); ++i) {
+        if (myRelaxed[i] != myNodes[0]) {
+            myRelaxed[i]->advance();
+        }
+    }
+}
+
+void GraphScene::endRelaxing() {
+    delete myFrozenTree;
+    myFrozenTree = 0;
+    myRelaxed.clear();
+}
+
+void GraphScene::calculateTreeForces() {
     QuadTree quadTree(graphCube().longestEdge());
     foreach (Node* node, nodes()) {
         quadTree.addNode(node);
     }
+    if (useQuadrupoles) {
+        quadTree.computeQuadrupoles();
+    }
 
     // Don't move the first node
+    int interactions = 0;
     bool first = true;
     foreach (Node *node, nodes()) {
         if (first) {
@@ -299,17 +514,214 @@ bool GraphScene::calculateForces() {
             continue;
         }
 
-        node->calculatePosition(quadTree.root());
+        node->calculatePosition(node->calculateRepulsion(quadTree.root(), myTolerance, interactions));
     }
 
-    bool somethingMoved = false;
-    foreach (Node *node, nodes()) {
-        if (node->advance()) {
-            somethingMoved = true;
+    myLayoutStats.interactions = interactions;
+    myLayoutStats.tolerance = myTolerance;
+
+    if (isInstrumented || myTargetError > 0) {
+        measureTreeError(quadTree);
+    }
+}
+
+bool GraphScene::calculateBudgetedForces(const QElapsedTimer &timer) {
+    const int n = myNodes.size();
+    if (n == 0) {
+        return true;
+    }
+
+    // Only the per-node loop is sliced, the mode's structure is still built
+    // over every node.
+    const REPULSION_MODES mode = activeRepulsionMode();
+    QuadTree quadTree(graphCube().longestEdge());
+    SpatialGrid grid(SpatialGrid::DEFAULT_CUTOFF, Node::REPULSION);
+    ExactForces exact(Node::REPULSION);
+    if (mode == REPULSION_GRID) {
+        grid.build(nodePositions());
+    } else if (mode == REPULSION_EXACT) {
+        exact.build(nodePositions());
+    } else {
+        foreach (Node* node, nodes()) {
+            quadTree.addNode(node);
+        }
+        if (useQuadrupoles) {
+            quadTree.computeQuadrupoles();
         }
     }
 
-    return somethingMoved;
+    // Move at least BUDGET_CHECK nodes, even if building alone went over.
+    mySliceStart %= n;
+    int interactions = 0;
+    int processed = 0;
+    while (processed < n) {
+        const int first = (mySliceStart + processed) % n;
+        const int count = qMin(BUDGET_CHECK, qMin(n - first, n - processed));
+        if (mode == REPULSION_EXACT) {
+            exact.calculate(first, count);
+            interactions += count * (n - 1);
+        }
+
+        for (int i = first; i < first + count; ++i) {
+            // Don't move the first node
+            if (i == 0) {
+                continue;
+            }
+
+            VPointF force;
+            if (mode == REPULSION_GRID) {
+                force = grid.force(i);
+            } else if (mode == REPULSION_EXACT) {
+                force = exact.force(i);
+            } else {
+                force = myNodes[i]->calculateRepulsion(quadTree.root(), myTolerance, interactions);
+            }
+            myNodes[i]->calculatePosition(force);
+        }
+        processed += count;
+
+        if (timer.nsecsElapsed() / 1e6 > myFrameBudget) {
+            break;
+        }
+    }
+
+    bool sweepDone = (mySliceStart + processed >= n);
+    mySliceStart = (mySliceStart + processed) % n;
+
+    myLayoutStats.interactions = interactions;
+    myLayoutStats.completed = (qreal) processed / n;
+
+    if (mode == REPULSION_QUADTREE) {
+        myLayoutStats.tolerance = myTolerance;
+        if (isInstrumented || myTargetError > 0) {
+            measureTreeError(quadTree);
+        }
+    }
+
+    return sweepDone;
+}
+
+// The mode that calculates the repulsion this frame, with REPULSION_AUTO
+// resolved by the number of nodes.
+GraphScene::REPULSION_MODES GraphScene::activeRepulsionMode() const {
+    if (myRepulsionMode != REPULSION_AUTO) {
+        return myRepulsionMode;
+    }
+    return (myNodes.size() < ExactForces::CROSSOVER) ? REPULSION_EXACT : REPULSION_QUADTREE;
+}
+
+void GraphScene::measureTreeError(QuadTree &quadTree) {
+    if (myNodes.isEmpty()) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    ExactForces exact(Node::REPULSION);
+    exact.build(nodePositions());
+
+    qreal sumSquares = 0.0;
+    for (int i(0); i < ERROR_SAMPLES; ++i) {
+        int index = qrand() % myNodes.size();
+        Node *node = myNodes[index];
+
+        // Leave the node itself out by index, a position compared to its own
+        // copy isn't always equal.
+        int ignored = 0;
+        VPointF approximate = node->calculateRepulsion(quadTree.root(), myTolerance, ignored);
+        VPointD truth = exact.forceAt(VPointD(node->pos()), index);
+
+        double magnitude = truth.length();
+        if (magnitude == 0) {
+            continue;
+        }
+
+        qreal error = (VPointD(approximate) - truth).length() / magnitude;
+        sumSquares += error * error;
+        myLayoutStats.maxError = qMax(myLayoutStats.maxError, error);
+        ++myLayoutStats.samples;
+    }
+
+    if (myLayoutStats.samples > 0) {
+        myLayoutStats.rmsError = sqrt(sumSquares / myLayoutStats.samples);
+
+        // Open fewer cells while there is error to spare, more when over.
+        if (myTargetError > 0) {
+            if (myLayoutStats.rmsError > myTargetError) {
+                myTolerance = qMax(MIN_TOLERANCE, myTolerance / TOLERANCE_STEP);
+            } else if (myLayoutStats.rmsError < myTargetError / 2) {
+                myTolerance = qMin(MAX_TOLERANCE, myTolerance * TOLERANCE_STEP);
+            }
+        }
+    }
+
+    myLayoutStats.samplingTime = timer.nsecsElapsed() / 1e6;
+}
+
+void GraphScene::calculateGridForces() {
+    SpatialGrid grid(SpatialGrid::DEFAULT_CUTOFF, Node::REPULSION);
+    grid.build(nodePositions());
+
+    // Don't move the first node
+    for (int i(1); i < myNodes.size(); ++i) {
+        myNodes[i]->calculatePosition(grid.force(i));
+    }
+}
+
+void GraphScene::calculateExactForces() {
+    ExactForces exact(Node::REPULSION);
+    exact.build(nodePositions());
+    exact.calculate();
+
+    myLayoutStats.interactions = myNodes.size() * (myNodes.size() - 1);
+
+    // Don't move the first node
+    for (int i(1); i < myNodes.size(); ++i) {
+        myNodes[i]->calculatePosition(exact.force(i));
+    }
+}
+
+void GraphScene::calculateFmmForces() {
+    QuadTree quadTree(graphCube().longestEdge());
+    foreach (Node* node, nodes()) {
+        quadTree.addNode(node);
+    }
+    quadTree.computeQuadrupoles();
+
+    FastMultipole fmm(Node::REPULSION);
+    fmm.calculate(quadTree);
+
+    myLayoutStats.interactions = fmm.interactions();
+    myLayoutStats.tolerance = FastMultipole::DEFAULT_TOLERANCE;
+
+    // The tree orders the nodes by position.  Don't move the first node.
+    for (int i(0); i < fmm.bodyCount(); ++i) {
+        Node *node = static_cast<Node*>(fmm.body(i));
+        if (node != myNodes[0]) {
+            node->calculatePosition(fmm.force(i));
+        }
+    }
+}
+
+QVector<VPointF> GraphScene::nodePositions() const {
+    QVector<VPointF> positions(myNodes.size());
+    for (int i(0); i < myNodes.size(); ++i) {
+        positions[i] = myNodes[i]->pos();
+    }
+    return positions;
+}
+
+GraphScene::LayoutStats::LayoutStats() :
+    frameTime(0.0),
+    samplingTime(0.0),
+    interactions(0),
+    tolerance(0.0),
+    samples(0),
+    rmsError(0.0),
+    maxError(0.0),
+    completed(1.0)
+{
 }
 
 int GraphScene::maxDegree() const {
@@ -324,6 +736,15 @@ int GraphScene::nodeCount(int degree) const {
     return degreeCount[degree].size();
 }
 
+// Pre: Node has just lost an edge
+void GraphScene::degreeDecrease(Node *node) {
+    int degree = node->edges().size();
+
+    degreeCount[degree].removeOne(node);
+    if (degree > 0)
+        degreeCount[degree - 1].append(node);
+}
+
 void GraphScene::degreeRemove(Node *node) {
     int degree = node->edges().size();
 
@@ -10,11 +10,13 @@
 #include <QMainWindow>
 
 #include "vtools.h"
+#include "quadtree.h"
 
 class Edge;
 class Node;
 class Algorithm;
 class Statistics;
+class QElapsedTimer;
 
 class GraphScene : public QObject
 {
@@ -23,6 +25,37 @@ public:
     explicit GraphScene(QObject *parent = 0);
     ~GraphScene();
 
+    // How the repulsion between nodes is calculated.
+    enum REPULSION_MODES {
+        // Exact for small graphs, QuadTree otherwise.
+        REPULSION_AUTO,
+        // Barnes-Hut approximation over a QuadTree.
+        REPULSION_QUADTREE,
+        // Exact repulsion inside a cutoff radius, coarse outside of it.
+        REPULSION_GRID,
+        // Exact repulsion between all pairs of nodes.
+        REPULSION_EXACT,
+        // Fast multipole method over a QuadTree, linear in the nodes.
+        REPULSION_FMM
+    };
+
+    // What the last call to calculateForces() cost and, when instrumented,
+    // how far the QuadTree repulsion was from the exact one on a sample of
+    // nodes.  Errors are relative to the magnitude of the exact force.
+    class LayoutStats {
+    public:
+        LayoutStats();
+
+        qreal frameTime;        // milliseconds, without the sampling
+        qreal samplingTime;     // milliseconds
+        int interactions;
+        vreal tolerance;
+        int samples;
+        qreal rmsError;
+        qreal maxError;
+        qreal completed;        // fraction of the nodes moved this frame
+    };
+
     QVector<Node*>& nodes();
     QList<Edge*>& edges();
     int maxDegree() const;
@@ -32,6 +65,10 @@ public:
 
     bool doesEdgeExist(Node *source, Node *dest) const;
 
+    // Changes whenever a node or an edge is added or removed, so results
+    // computed for one version still hold while it stays the same.
+    quint64 version() const;
+
     Node* newNode();
     bool newEdge(Node *source, Node *dest);
 
@@ -42,12 +79,50 @@ public:
     bool calculateForces();
     void reset();
 
+    // While a node is dragged, only the nodes up to the given number of hops
+    // from it are laid out, each call to relaxAround() moving them a step.
+    // The rest of the graph is frozen until endRelaxing(), and still repels
+    // the nodes that move.  The center itself stays put.
+    void beginRelaxing(Node *center, int hops);
+    void relaxAround();
+    void endRelaxing();
+
+    REPULSION_MODES repulsionMode() const;
+    void setRepulsionMode(REPULSION_MODES mode);
+
+    const LayoutStats& layoutStats() const;
+    bool instrumented() const;
+    void setInstrumented(bool enabled);
+
+    // The QuadTree opening criterion, see QuadTree::TreeNode::isFarEnough().
+    vreal tolerance() const;
+    void setTolerance(vreal newTolerance);
+    vreal defaultTolerance() const;
+
+    // Whether far away QuadTree cells repel with their quadrupole moments as
+    // well as their center of mass.  Resets the tolerance to the default.
+    bool quadrupoles() const;
+    void setQuadrupoles(bool enabled);
+
+    // With a target RMS error above 0, the tolerance is adapted every frame
+    // to the loosest one that meets it.
+    qreal targetError() const;
+    void setTargetError(qreal error);
+
+    // With a budget above 0 milliseconds, each frame only moves as many
+    // nodes as the budget allows, picking up where the last frame stopped.
+    // The fast multipole method finds every force in one pass, so it
+    // ignores the budget.
+    qreal frameBudget() const;
+    void setFrameBudget(qreal milliseconds);
+    bool budgeted() const;
+
     QList<QString> algorithms() const;
 
     VCubeF graphCube();
-    void removeNode(Node *n);
     void setAllNodes(int i);
-    void removeEdges(int cutoffTag);
+    // Removes the edge between the two nodes, whichever way round it was
+    // added.
     void removeEdge(Node * source, Node* dst);
 
     Statistics* getStatistics();
@@ -73,8 +148,24 @@ signals:
     void algorithmChanged(Algorithm *newAlgo);
     void repopulated();
 
+    // Changes to the structure of the graph, after they have been made.
+    void nodeAdded(Node *node);
+    void edgeAdded(Node *source, Node *dest);
+    void edgeRemoved(Node *source, Node *dest);
+    void cleared();
+
 protected:
     void updateDegreeCount(Node *node);
+    void degreeDecrease(Node *node);
+
+    void calculateTreeForces();
+    void calculateGridForces();
+    void calculateExactForces();
+    void calculateFmmForces();
+    bool calculateBudgetedForces(const QElapsedTimer &timer);
+    REPULSION_MODES activeRepulsionMode() const;
+    void measureTreeError(QuadTree &quadTree);
+    QVector<VPointF> nodePositions() const;
 
 private:
     enum ALGOS {
@@ -87,6 +178,7 @@ private:
     Statistics *stats;
     int algoId;
     QVector<QSet<int> > hasEdge;
+    quint64 myVersion;
     QVector<Node*> myNodes;
     QList<Edge*> myEdges;
     QVector<QList<Node*> > degreeCount;
@@ -94,6 +186,20 @@ private:
 
     QColor myBackgroundColour;
     bool mode3d;
+    REPULSION_MODES myRepulsionMode;
+    bool isInstrumented;
+    bool useQuadrupoles;
+    vreal myTolerance;
+    qreal myTargetError;
+    qreal myFrameBudget;
+    int mySliceStart;
+    bool sweepMoved;
+    LayoutStats myLayoutStats;
+
+    // The neighbourhood being relaxed, center first, and the rest of the
+    // graph's repulsion.
+    QVector<Node*> myRelaxed;
+    QuadTree *myFrozenTree;
 
     QColor myEdgeColour;
     QColor myNodeColour;
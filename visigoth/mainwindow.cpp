@@ -1,4 +1,5 @@
 #include "algorithm.h"
+#include "compactgraph.h"
 #include "graphscene.h"
 #include "glgraphwidget.h"
 #include "mainwindow.h"
@@ -21,6 +22,26 @@
 #include <QMessageBox>
 #include <QColorDialog>
 #include <QUrl>
+#include <QThreadPool>
+#include <QtConcurrentRun>
+
+#include <math.h>
+
+// Above Statistics::SAMPLING_THRESHOLD nodes, the average path length is
+// estimated to within this fraction of itself.
+static const double SAMPLING_ERROR = 0.005;
+
+// Each community's hue is this far round the colour wheel from the last
+// one's, so that however many there are, no two are close together.
+static const double GOLDEN_RATIO_CONJUGATE = 0.618033988749895;
+
+// An estimate and the half width of its error bar, or just the value if it
+// is exact.
+static QString withError(double value, double error) {
+    if (error == 0.0)
+        return QString::number(value);
+    return QString("%1 %2 %3").arg(value).arg(QChar(0x00B1)).arg(error);
+}
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
@@ -28,7 +49,13 @@ MainWindow::MainWindow(QWidget *parent) :
     statsUi(new Ui::Statistics),
     algoCtl(0),
     helpWidget(0),
-    focusedNode(0)
+    focusedNode(0),
+    pathVersion(0),
+    diameterVersion(0),
+    communityVersion(0),
+    centralityShown(false),
+    centralityVersion(0),
+    communitiesShown(false)
 {
     qsrand(23);
 
@@ -62,6 +89,8 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(scene, SIGNAL(repopulated()), this, SLOT(onGenerate()));
     connect(view, SIGNAL(algorithmChanged(Algorithm*)), this, SLOT(onAlgorithmChanged(Algorithm*)));
     connect(view, SIGNAL(onSelectNode(Node*)), this, SLOT(onFocusedNodeChanged(Node*)));
+    connect(view, SIGNAL(centralityToggled(bool)), this, SLOT(onCentralityToggled(bool)));
+    connect(view, SIGNAL(communitiesToggled(bool)), this, SLOT(onCommunitiesToggled(bool)));
 
     ui->chooserCombo->addItems(scene->algorithms());
     connect(ui->chooserCombo, SIGNAL(currentIndexChanged(const QString &)), scene, SLOT(chooseAlgorithm(const QString &)));
@@ -74,6 +103,10 @@ MainWindow::MainWindow(QWidget *parent) :
 }
 
 MainWindow::~MainWindow() {
+    // Cancelled statistics may still be winding down
+    cancelStatistics();
+    QThreadPool::globalInstance()->waitForDone();
+
     delete view;
     delete ui;
 }
@@ -177,10 +210,214 @@ void MainWindow::onAlgorithmChanged(Algorithm *newAlgo) {
 void MainWindow::onGenerate() {
     focusedNode = 0;
     Statistics *stats = scene->getStatistics();
-    statsUi->lengthLabel->setText(QString::number(stats->lengthAvg()));
+
+    // A result for the previous graph would be stale by now.
+    cancelStatistics();
+
+    // Kept up to date as the graph was built
     statsUi->degreeLabel->setText(QString::number(stats->degreeAvg()));
     statsUi->clusteringLabel->setText(QString::number(stats->clusteringAvg()));
+    statsUi->transitivityLabel->setText(QString::number(stats->transitivity()));
     statsUi->exponentLabel->setText(QString::number(stats->powerLawExponent()));
+    statsUi->giantLabel->setText(QString("%1 / %2").arg(stats->giantComponentSize()).arg(scene->nodes().size()));
+
+    if (stats->hasPathStatistics()) {
+        showPathStatistics(stats->pathStatistics());
+    } else {
+        startPathStatistics();
+    }
+    if (stats->hasDiameterStatistics()) {
+        showDiameterStatistics(stats->diameterStatistics());
+    } else {
+        startDiameterStatistics();
+    }
+    if (stats->hasCommunityStatistics()) {
+        showCommunityStatistics(stats->communityStatistics());
+    } else {
+        startCommunityStatistics();
+    }
+    if (centralityShown) {
+        startCentrality();
+    }
+}
+
+void MainWindow::startPathStatistics() {
+    statsUi->lengthLabel->setText("...");
+    CompactGraph compact = scene->getStatistics()->compactGraph();
+    pathVersion = scene->version();
+    StatisticsTask<Statistics::PathStatistics> *paths = new StatisticsTask<Statistics::PathStatistics>(this);
+    connect(paths, SIGNAL(progress(int,int)), this, SLOT(onPathProgress(int,int)));
+    if (compact.vertexCount() > Statistics::SAMPLING_THRESHOLD) {
+        paths->setFuture(QtConcurrent::run(&Statistics::sampledPathStatisticsOf,
+                                           compact, SAMPLING_ERROR, paths->progress()));
+    } else {
+        paths->setFuture(QtConcurrent::run(&Statistics::pathStatisticsOf,
+                                           compact, paths->progress()));
+    }
+    startStatistics(paths, SLOT(onPathStatisticsReady()));
+}
+
+void MainWindow::onPathProgress(int done, int total) {
+    statsUi->lengthLabel->setText(QString("... %1%").arg(100 * done / total));
+}
+
+void MainWindow::onPathStatisticsReady() {
+    Statistics::PathStatistics result =
+        static_cast<StatisticsTask<Statistics::PathStatistics>*>(finishedStatistics())->result();
+    scene->getStatistics()->cachePathStatistics(result, pathVersion);
+    showPathStatistics(result);
+}
+
+void MainWindow::showPathStatistics(const Statistics::PathStatistics &result) {
+    if (result.exact) {
+        statsUi->lengthLabel->setText(QString::number(result.lengthAvg));
+    } else {
+        statsUi->lengthLabel->setText(withError(result.lengthAvg, result.lengthError));
+    }
+}
+
+void MainWindow::startDiameterStatistics() {
+    statsUi->diameterLabel->setText("...");
+    statsUi->radiusLabel->setText("...");
+    diameterVersion = scene->version();
+    StatisticsTask<Statistics::DiameterStatistics> *extremes = new StatisticsTask<Statistics::DiameterStatistics>(this);
+    extremes->setFuture(QtConcurrent::run(&Statistics::diameterStatisticsOf,
+                                          scene->getStatistics()->compactGraph(), extremes->progress()));
+    startStatistics(extremes, SLOT(onDiameterStatisticsReady()));
+}
+
+void MainWindow::onDiameterStatisticsReady() {
+    Statistics::DiameterStatistics result =
+        static_cast<StatisticsTask<Statistics::DiameterStatistics>*>(finishedStatistics())->result();
+    scene->getStatistics()->cacheDiameterStatistics(result, diameterVersion);
+    showDiameterStatistics(result);
+}
+
+void MainWindow::showDiameterStatistics(const Statistics::DiameterStatistics &result) {
+    statsUi->diameterLabel->setText(QString::number(result.diameter));
+    statsUi->radiusLabel->setText(QString::number(result.radius));
+}
+
+void MainWindow::startCommunityStatistics() {
+    statsUi->modularityLabel->setText("...");
+    communityVersion = scene->version();
+    StatisticsTask<Statistics::CommunityStatistics> *partition =
+        new StatisticsTask<Statistics::CommunityStatistics>(this);
+    partition->setFuture(QtConcurrent::run(&Statistics::communityStatisticsOf,
+                                           scene->getStatistics()->compactGraph(), partition->progress()));
+    startStatistics(partition, SLOT(onCommunityStatisticsReady()));
+}
+
+void MainWindow::onCommunityStatisticsReady() {
+    Statistics::CommunityStatistics result =
+        static_cast<StatisticsTask<Statistics::CommunityStatistics>*>(finishedStatistics())->result();
+    scene->getStatistics()->cacheCommunityStatistics(result, communityVersion);
+    showCommunityStatistics(result);
+}
+
+void MainWindow::showCommunityStatistics(const Statistics::CommunityStatistics &result) {
+    statsUi->modularityLabel->setText(QString("%1 (%2 communities)")
+                                      .arg(result.modularity).arg(result.count));
+    if (communitiesShown) {
+        colourCommunities(result.communities);
+    }
+}
+
+void MainWindow::onCommunitiesToggled(bool shown) {
+    communitiesShown = shown;
+    Statistics *stats = scene->getStatistics();
+    if (!shown) {
+        scene->customizeNodesColour(scene->nodeColour());
+    } else if (stats->hasCommunityStatistics()) {
+        colourCommunities(stats->communityStatistics().communities);
+    }
+    // Otherwise they are coloured once the communities are ready.
+}
+
+/* Colours the nodes through Node::setColour, keeping the alpha of the
+nodes' colour. */
+void MainWindow::colourCommunities(const QVector<int> &communities) {
+    QVector<Node*> &nodes = scene->nodes();
+    if (communities.size() != nodes.size()) {
+        // For another version of the graph
+        return;
+    }
+
+    const qreal alpha = scene->nodeColour().alphaF();
+    for (int i(0); i < nodes.size(); ++i) {
+        qreal hue = fmod(communities[i] * GOLDEN_RATIO_CONJUGATE, 1.0);
+        nodes[i]->setColour(QColor::fromHsvF(hue, 0.8, 1.0, alpha));
+    }
+    view->update();
+}
+
+void MainWindow::onCentralityToggled(bool shown) {
+    centralityShown = shown;
+    if (shown) {
+        startCentrality();
+    }
+}
+
+/* Betweenness of every node, sampled on larger graphs, for the view to
+draw them by. */
+void MainWindow::startCentrality() {
+    CompactGraph compact = scene->getStatistics()->compactGraph();
+    centralityVersion = scene->version();
+    StatisticsTask<QVector<double> > *betweenness = new StatisticsTask<QVector<double> >(this);
+    if (compact.vertexCount() > Statistics::BETWEENNESS_THRESHOLD) {
+        int sources = Statistics::BETWEENNESS_SOURCES;
+        betweenness->setFuture(QtConcurrent::run(&Statistics::sampledBetweennessOf,
+                                                 compact, sources, betweenness->progress()));
+    } else {
+        betweenness->setFuture(QtConcurrent::run(&Statistics::betweennessOf,
+                                                 compact, betweenness->progress()));
+    }
+    startStatistics(betweenness, SLOT(onCentralityReady()));
+    Notify::normal("Computing betweenness centrality");
+}
+
+void MainWindow::onCentralityReady() {
+    QVector<double> betweenness =
+        static_cast<StatisticsTask<QVector<double> >*>(finishedStatistics())->result();
+    if (centralityVersion != scene->version()) {
+        // The nodes may no longer match the snapshot's vertices.
+        startCentrality();
+        return;
+    }
+
+    double most = 0.0;
+    foreach (double b, betweenness) {
+        most = qMax(most, b);
+    }
+    QVector<Node*> &nodes = scene->nodes();
+    for (int i(0); i < nodes.size(); ++i) {
+        nodes[i]->setCentrality((most > 0.0) ? betweenness[i] / most : 0.0);
+    }
+    view->update();
+    Notify::normal("All ready");
+}
+
+/* Keeps track of a background statistic until it calls the onReady slot,
+which should start with finishedStatistics(). */
+void MainWindow::startStatistics(StatisticsJob *job, const char *onReady) {
+    statisticsJobs << job;
+    connect(job, SIGNAL(finished()), this, onReady);
+}
+
+/* The job that has just finished, which deletes itself once back in the
+event loop. */
+StatisticsJob* MainWindow::finishedStatistics() {
+    StatisticsJob *job = static_cast<StatisticsJob*>(sender());
+    statisticsJobs.removeOne(job);
+    return job;
+}
+
+void MainWindow::cancelStatistics() {
+    // They wind down on their own.
+    foreach (StatisticsJob *job, statisticsJobs) {
+        job->cancel();
+    }
+    statisticsJobs.clear();
 }
 
 void MainWindow::onFocusedNodeChanged(Node *node) {
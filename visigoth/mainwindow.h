@@ -2,10 +2,12 @@
 #define MAINWINDOW_H
 
 #include "glgraphwidget.h"
+#include "statistics.h"
 
 #include <QColor>
 #include <QComboBox>
 #include <QGraphicsView>
+#include <QList>
 #include <QMainWindow>
 
 class Algorithm;
@@ -35,6 +37,13 @@ private slots:
     void onAlgorithmChanged(Algorithm *newAlgo);
     void onGenerate();
     void onFocusedNodeChanged(Node *node);
+    void onPathProgress(int done, int total);
+    void onPathStatisticsReady();
+    void onDiameterStatisticsReady();
+    void onCentralityToggled(bool shown);
+    void onCentralityReady();
+    void onCommunityStatisticsReady();
+    void onCommunitiesToggled(bool shown);
     bool pickColour(QColor &newColour);
     void showAbout();
     void showAboutQt();
@@ -48,6 +57,33 @@ private:
     QWidget *helpWidget;
     QDockWidget *helpDock;
     Node *focusedNode;
+
+    // The statistics being computed in the background, on a snapshot of
+    // the graph; they are stale once it changes.
+    QList<StatisticsJob*> statisticsJobs;
+    // Of the graph the path, diameter and community statistics are being
+    // computed on
+    quint64 pathVersion;
+    quint64 diameterVersion;
+    quint64 communityVersion;
+    // The nodes are drawn by their centrality, which is recomputed with
+    // every new graph.
+    bool centralityShown;
+    quint64 centralityVersion;
+    // The nodes are coloured by their community.
+    bool communitiesShown;
+
+    void startStatistics(StatisticsJob *job, const char *onReady);
+    StatisticsJob* finishedStatistics();
+    void cancelStatistics();
+    void startPathStatistics();
+    void showPathStatistics(const Statistics::PathStatistics &result);
+    void startDiameterStatistics();
+    void showDiameterStatistics(const Statistics::DiameterStatistics &result);
+    void startCentrality();
+    void startCommunityStatistics();
+    void showCommunityStatistics(const Statistics::CommunityStatistics &result);
+    void colourCommunities(const QVector<int> &communities);
 };
 
 #endif // MAINWINDOW_H
@@ -11,13 +11,16 @@ int Node::ALL_NODES(0);
 Node::Node(GraphScene *graph) :
     QObject(graph),
     graph(graph),
+    prevPos(0.0),
     curPos(0.0),
     newPos(0.0),
     allowAdvance(true),
     visited(false),
     distance(0),
     myColour(QColor::fromRgbF(0.0, 1.0, 0.3, 0.7)),
-    isHighlighted(false)
+    isHighlighted(false),
+    myCentrality(0.0),
+    myCore(0)
 {
     myTag = ALL_NODES++;
 }
@@ -33,19 +36,29 @@ void Node::addEdge(Edge *edge) {
     edgeList << edge;
 }
 
+void Node::removeEdge(Edge *edge) {
+    edgeList.removeOne(edge);
+}
+
 VPointF Node::pos() const {
     return curPos;
 }
 
 void Node::setPos(VPointF pos, bool silent) {
+    // Nodes that aren't recalculated every frame must stay where they were
+    // put, and are drawn there straight away.
+    prevPos = pos;
     curPos = pos;
+    newPos = pos;
     if (!silent)
         emit nodeMoved();
 }
 
-VPointF Node::calculatePosition(TreeNode &treeNode) {
-    VPointF vel = calculateNonEdgeForces(&treeNode);
+VPointF Node::calculateRepulsion(TreeNode &treeNode, vreal tolerance, int &interactions) {
+    return calculateNonEdgeForces(&treeNode, tolerance, interactions);
+}
 
+VPointF Node::calculatePosition(VPointF vel) {
     // Now all the forces that pulling items together
     double weight = (edgeList.size() + 1) * 10;
 
@@ -68,7 +81,7 @@ VPointF Node::calculatePosition(TreeNode &treeNode) {
     return newPos;
 }
 
-VPointF Node::calculateNonEdgeForces(QuadTree::TreeNode* treeNode) {
+VPointF Node::calculateNonEdgeForces(QuadTree::TreeNode* treeNode, vreal tolerance, int &interactions) {
     if (treeNode->size() < 1) {
         return VPointF(0.0);
     }
@@ -76,31 +89,43 @@ VPointF Node::calculateNonEdgeForces(QuadTree::TreeNode* treeNode) {
     VPointF vec = this->pos() - treeNode->center();
     VPointF vel = VPointF(0.0);
 
-    if (treeNode->isFarEnough(vec.length()) || treeNode->size() == 1) {
+    if (treeNode->isFarEnough(vec.length(), tolerance) || treeNode->size() == 1) {
         double l = vec.lengthSquared();
+        ++interactions;
 
         if (l > 0) {
-            vel = vec * (75.0 / l) * treeNode->size();
+            vel = vec * ((vreal) REPULSION / l) * treeNode->size();
+
+            // Zero unless the tree computed its quadrupoles
+            if (treeNode->size() > 1) {
+                vel = vel + treeNode->quadrupole().force(vec) * (vreal) REPULSION;
+            }
         } else {
             vel = VPointF(0.0);
         }
     } else {
         vel = VPointF(0.0);
         foreach (TreeNode* child, treeNode->children()) {
-            vel = vel + calculateNonEdgeForces(child);
+            vel = vel + calculateNonEdgeForces(child, tolerance, interactions);
         }
     }
     return vel;
 }
 
+VPointF Node::displayPos(qreal alpha) const {
+    return prevPos + (curPos - prevPos) * alpha;
+}
+
 bool Node::advance() {
+    prevPos = curPos;
+
     if (!allowAdvance)
         return false;
 
     if (newPos == pos())
         return false;
 
-    setPos(newPos, true);
+    curPos = newPos;
 
     return true;
 }
@@ -132,6 +157,22 @@ void Node::setHighlight(bool enabled) {
     isHighlighted =  enabled;
 }
 
+qreal Node::centrality() const {
+    return myCentrality;
+}
+
+void Node::setCentrality(qreal centrality) {
+    myCentrality = centrality;
+}
+
+int Node::core() const {
+    return myCore;
+}
+
+void Node::setCore(int core) {
+    myCore = core;
+}
+
 void Node::reset() {
     ALL_NODES = 0;
 }
@@ -152,6 +193,10 @@ vreal Node::width() const {
     return 0;
 }
 
+QuadTree::Quadrupole Node::quadrupole() const {
+    return QuadTree::Quadrupole();
+}
+
 QColor& Node::colour() {
     return myColour;
 }
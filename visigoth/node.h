@@ -23,14 +23,23 @@ public:
     friend class GraphScene;
 
     void addEdge(Edge *edge);
+    void removeEdge(Edge *edge);
 
     int tag() const;
 
     VPointF pos() const;
     void setPos(VPointF pos, bool silent = false);
 
-    /* Return the new position. */
-    VPointF calculatePosition(QuadTree::TreeNode& treeNode);
+    /* Where to draw the node, alpha of the way from its position before the
+     * last advance() to its current one. */
+    VPointF displayPos(qreal alpha) const;
+
+    /* Return the new position, given the repulsion from the other nodes. */
+    VPointF calculatePosition(VPointF repulsion);
+
+    /* Barnes-Hut approximation of the repulsion from the other nodes.
+     * Every tree node the force is taken from counts as an interaction. */
+    VPointF calculateRepulsion(QuadTree::TreeNode& treeNode, vreal tolerance, int &interactions);
     VPointF calculatePosition3D(QVector<Node*>& nodes);
 
     bool advance();
@@ -44,6 +53,7 @@ public:
     VPointF center() const;
     const QVector<TreeNode*>& children() const;
     vreal width() const;
+    QuadTree::Quadrupole quadrupole() const;
 
     QColor& colour();
     void setColour(const QColor &b);
@@ -51,8 +61,20 @@ public:
     bool highlighted() const;
     void setHighlight(bool enabled);
 
+    /* Betweenness relative to the most central node, from 0 to 1. */
+    qreal centrality() const;
+    void setCentrality(qreal centrality);
+
+    /* Its core number, as last set by the view; see
+     * Statistics::coreNumbers(). */
+    int core() const;
+    void setCore(int core);
+
     static void reset();
 
+    // Strength of the repulsion between any two nodes.
+    static const int REPULSION = 75;
+
 signals:
     void nodeMoved();
 
@@ -68,6 +90,7 @@ private:
     GraphScene *graph;
     QList<Edge*> edgeList;
 
+    VPointF prevPos;
     VPointF curPos;
     VPointF newPos;
     bool allowAdvance;
@@ -78,8 +101,10 @@ private:
 
     QColor myColour;
     bool isHighlighted;
+    qreal myCentrality;
+    int myCore;
 
-    VPointF calculateNonEdgeForces(TreeNode* treeNode);
+    VPointF calculateNonEdgeForces(TreeNode* treeNode, vreal tolerance, int &interactions);
 };
 
 #endif // NODE_H
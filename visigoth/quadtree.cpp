@@ -44,11 +44,53 @@ void QuadTree::addNode(QuadTree::TreeNode *node) {
     _root->addChild(node);
 }
 
+void QuadTree::computeQuadrupoles() {
+    _root->computeQuadrupole();
+}
+
+
+// ---------------------------------------------------------------------------
+// QuadTree::Quadrupole
+
+QuadTree::Quadrupole::Quadrupole() :
+    xx(0.0), yy(0.0), zz(0.0), xy(0.0), xz(0.0), yz(0.0)
+{
+}
+
+void QuadTree::Quadrupole::add(const Quadrupole &q, const VPointF &offset, vreal mass) {
+    // Parallel axis theorem
+    xx += q.xx + mass * offset.x * offset.x;
+    yy += q.yy + mass * offset.y * offset.y;
+    zz += q.zz + mass * offset.z * offset.z;
+    xy += q.xy + mass * offset.x * offset.y;
+    xz += q.xz + mass * offset.x * offset.z;
+    yz += q.yz + mass * offset.y * offset.z;
+}
+
+VPointF QuadTree::Quadrupole::force(const VPointF &r) const {
+    // The repulsion r/|r|^2 derives from the potential -ln|r|.  Expanding it
+    // to second order around the center of mass gives, with S the moments,
+    //   F = -(tr S) r / |r|^4 - 2 S r / |r|^4 + 4 (r.S.r) r / |r|^6
+    VPointF sr(xx * r.x + xy * r.y + xz * r.z,
+               xy * r.x + yy * r.y + yz * r.z,
+               xz * r.x + yz * r.y + zz * r.z);
+    vreal l = r.x * r.x + r.y * r.y + r.z * r.z;
+    vreal l2 = l * l;
+    vreal rsr = r.x * sr.x + r.y * sr.y + r.z * sr.z;
+    vreal trace = xx + yy + zz;
+
+    return r * ((4 * rsr / l - trace) / l2) - sr * (2 / l2);
+}
+
 
 // ---------------------------------------------------------------------------
 // QuadTree::TreeNode
 
-bool QuadTree::TreeNode::isFarEnough(vreal distance) {
+bool QuadTree::TreeNode::isFarEnough(vreal distance) const {
+    return isFarEnough(distance, tolerance);
+}
+
+bool QuadTree::TreeNode::isFarEnough(vreal distance, vreal tolerance) const {
     return (width() / distance) <= tolerance;
 }
 
@@ -89,6 +131,27 @@ vreal QuadTree::Quadrant::width() const {
     return (vreal) _width;
 }
 
+QuadTree::Quadrupole QuadTree::Quadrant::quadrupole() const {
+    return _quadrupole;
+}
+
+void QuadTree::Quadrant::computeQuadrupole() {
+    _quadrupole = Quadrupole();
+
+    foreach (TreeNode *child, _children) {
+        if (child->size() < 1) {
+            continue;
+        }
+
+        // Only terminal quadrants hold graph nodes.
+        if (!isTerminal()) {
+            static_cast<QuadTree::Quadrant*>(child)->computeQuadrupole();
+        }
+
+        _quadrupole.add(child->quadrupole(), child->center() - _center, child->size());
+    }
+}
+
 void QuadTree::Quadrant::castAndAddChild(QuadTree::TreeNode *node, QuadTree::TreeNode *child) const {
     QuadTree::Quadrant *q = dynamic_cast<QuadTree::Quadrant*>(node);
 
@@ -9,19 +9,41 @@
 class QuadTree
 {
 public:
+    // The second moments of the masses in a tree node around its center, the
+    // next term after the center of mass in the multipole expansion of the
+    // repulsion.
+    class Quadrupole {
+    public:
+        Quadrupole();
+
+        vreal xx, yy, zz, xy, xz, yz;
+
+        // Adds the moments q of a child of the given mass whose center is
+        // offset from this one's.
+        void add(const Quadrupole &q, const VPointF &offset, vreal mass);
+
+        // The correction to the 1/r repulsion of the center of mass felt at
+        // offset r from it, per unit of strength.
+        VPointF force(const VPointF &r) const;
+    };
+
     class TreeNode {
     public:
         virtual int size() const = 0;
         virtual VPointF center() const = 0;
         virtual const QVector<TreeNode*>& children() const = 0;
         virtual vreal width() const = 0;
+        virtual Quadrupole quadrupole() const = 0;
 
         // Checks if a node is "far enough", that is if we should calculate the force based
         // on the current node.
-        bool isFarEnough(vreal distance);
+        bool isFarEnough(vreal distance) const;
+        bool isFarEnough(vreal distance, vreal tolerance) const;
 
-        // A fixed tolerance. The higher the tolerance, the more unstable the graph.
+        // The default tolerance. The higher the tolerance, the more unstable the graph.
         static const vreal tolerance = 0.8;
+        // Quadrupoles are as accurate at this looser tolerance.
+        static const vreal quadrupoleTolerance = 1.0;
     };
 
 
@@ -30,6 +52,9 @@ public:
     void addNode(TreeNode *node);
     TreeNode& root() const;
 
+    // Call once all the nodes are added to use quadrupoles in the far field.
+    void computeQuadrupoles();
+
 private:
     class Quadrant : public TreeNode {
     public:
@@ -39,10 +64,12 @@ private:
         VPointF center() const;
         const QVector<TreeNode*>& children() const;
         vreal width() const;
+        Quadrupole quadrupole() const;
 
         static const int CHILDREN = 8;
 
         void addChild(TreeNode *child);
+        void computeQuadrupole();
 
     private:
         enum CUBE_X {
@@ -65,6 +92,7 @@ private:
         int _width;
         int _size;
         VPointF _center;
+        Quadrupole _quadrupole;
 
         int childIndex(TreeNode& node) const;
         void castAndAddChild(TreeNode *node, TreeNode *child) const;
@@ -0,0 +1,361 @@
+#include <cmath>
+
+#include <QPair>
+#include <QtAlgorithms>
+
+#include "spatialgrid.h"
+
+// Large primes used to hash cell coordinates into buckets.
+static const unsigned int HASH_X = 73856093;
+static const unsigned int HASH_Y = 19349663;
+static const unsigned int HASH_Z = 83492791;
+
+// Bits per coordinate in a Morton code.
+static const int MORTON_BITS = 21;
+
+static inline unsigned int bucket(int x, int y, int z, unsigned int mask) {
+    return (((unsigned int) x * HASH_X) ^
+            ((unsigned int) y * HASH_Y) ^
+            ((unsigned int) z * HASH_Z)) & mask;
+}
+
+// Orders cell coordinates stored as (x, y, z) triples.
+static inline bool coordsLess(const int *a, const int *b) {
+    if (a[0] != b[0]) {
+        return a[0] < b[0];
+    }
+    if (a[1] != b[1]) {
+        return a[1] < b[1];
+    }
+    return a[2] < b[2];
+}
+
+static inline bool coordsEqual(const int *a, const int *b) {
+    return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+// Spreads the low MORTON_BITS bits of v two bits apart.
+static inline quint64 spreadBits(int v) {
+    quint64 x = qMin(v, (1 << MORTON_BITS) - 1);
+    x = (x | x << 32) & Q_UINT64_C(0x1f00000000ffff);
+    x = (x | x << 16) & Q_UINT64_C(0x1f0000ff0000ff);
+    x = (x | x << 8) & Q_UINT64_C(0x100f00f00f00f00f);
+    x = (x | x << 4) & Q_UINT64_C(0x10c30c30c30c30c3);
+    x = (x | x << 2) & Q_UINT64_C(0x1249249249249249);
+    return x;
+}
+
+// Whether a cell of the same grid is next to, or the same as, the other.
+static inline bool adjacent(int x1, int y1, int z1, int x2, int y2, int z2) {
+    return qAbs(x1 - x2) <= 1 && qAbs(y1 - y2) <= 1 && qAbs(z1 - z2) <= 1;
+}
+
+
+// ---------------------------------------------------------------------------
+// SpatialGrid
+
+SpatialGrid::SpatialGrid(vreal cutoff, vreal strength) :
+    maxCutoff(cutoff),
+    cellWidth(cutoff),
+    strength(strength)
+{
+}
+
+vreal SpatialGrid::cutoff() const {
+    return cellWidth;
+}
+
+void SpatialGrid::build(const QVector<VPointF> &newPositions) {
+    positions = newPositions;
+
+    if (positions.isEmpty()) {
+        sorted.clear();
+        cellOf.clear();
+        cells.clear();
+        neighbourStart.clear();
+        neighbours.clear();
+        return;
+    }
+
+    VPointF low = positions[0];
+    VPointF high = positions[0];
+    foreach (const VPointF &p, positions) {
+        low = VPointF(qMin(low.x, p.x), qMin(low.y, p.y), qMin(low.z, p.z));
+        high = VPointF(qMax(high.x, p.x), qMax(high.y, p.y), qMax(high.z, p.z));
+    }
+
+    // Shrink the cells if the nodes are packed tightly, otherwise every node
+    // would see most of the graph in its near field.
+    VPointF extent = high - low;
+    vreal spacing;
+    if (high.z == low.z) {
+        spacing = sqrt(extent.x * extent.y / positions.size());
+    } else {
+        spacing = pow(extent.x * extent.y * extent.z / positions.size(), 1.0 / 3.0);
+    }
+    cellWidth = maxCutoff;
+    if (spacing > 0) {
+        cellWidth = qMax((vreal) 1.0, qMin(maxCutoff, NEIGHBOURHOOD * spacing));
+    }
+
+    buildCells(low);
+    buildPyramid();
+}
+
+VPointF SpatialGrid::force(int i) const {
+    const VPointF &p = positions[i];
+    const int c = cellOf[i];
+
+    VPointF vel = VPointF(0.0);
+    for (int n = neighbourStart[c]; n < neighbourStart[c + 1]; ++n) {
+        const Cell &cell = cells[neighbours[n]];
+        for (int k = cell.first; k < cell.last; ++k) {
+            int j = sorted[k];
+            if (j == i) {
+                continue;
+            }
+
+            VPointF vec = p - positions[j];
+            vreal l = vec.lengthSquared();
+            if (l > 0) {
+                vel = vel + vec * (strength / l);
+            }
+        }
+    }
+
+    return vel + cells[c].farFieldAt(p);
+}
+
+inline int SpatialGrid::cellCoord(vreal v) const {
+    return (int) floor(v / cellWidth);
+}
+
+void SpatialGrid::buildCells(const VPointF &low) {
+    const int n = positions.size();
+    const int lowX = cellCoord(low.x);
+    const int lowY = cellCoord(low.y);
+    const int lowZ = cellCoord(low.z);
+
+    // Twice as many buckets as nodes keeps collisions rare.
+    unsigned int buckets = 16;
+    while (buckets < 2 * (unsigned int) n) {
+        buckets <<= 1;
+    }
+    const unsigned int mask = buckets - 1;
+
+    // Counting sort of the nodes by bucket.
+    QVector<int> coords(3 * n);
+    QVector<unsigned int> keys(n);
+    QVector<int> start(buckets + 1, 0);
+    for (int i = 0; i < n; ++i) {
+        const VPointF &p = positions[i];
+        int *c = coords.data() + 3 * i;
+        c[0] = cellCoord(p.x) - lowX;
+        c[1] = cellCoord(p.y) - lowY;
+        c[2] = cellCoord(p.z) - lowZ;
+        keys[i] = bucket(c[0], c[1], c[2], mask);
+        ++start[keys[i] + 1];
+    }
+
+    for (unsigned int b = 0; b < buckets; ++b) {
+        start[b + 1] += start[b];
+    }
+
+    QVector<int> next(start);
+    sorted.resize(n);
+    for (int i = 0; i < n; ++i) {
+        sorted[next[keys[i]]++] = i;
+    }
+
+    // Split the buckets into cells.  A bucket almost always holds a single
+    // cell, so an insertion sort by coordinates is enough to group them.
+    QVector<Cell> unordered;
+    for (unsigned int b = 0; b < buckets; ++b) {
+        for (int k = start[b] + 1; k < start[b + 1]; ++k) {
+            int i = sorted[k];
+            int m = k;
+            while (m > start[b] && coordsLess(coords.constData() + 3 * i,
+                                              coords.constData() + 3 * sorted[m - 1])) {
+                sorted[m] = sorted[m - 1];
+                --m;
+            }
+            sorted[m] = i;
+        }
+
+        for (int k = start[b]; k < start[b + 1]; ++k) {
+            int i = sorted[k];
+            if (k == start[b] || !coordsEqual(coords.constData() + 3 * i,
+                                              coords.constData() + 3 * sorted[k - 1])) {
+                Cell cell;
+                cell.x = coords[3 * i];
+                cell.y = coords[3 * i + 1];
+                cell.z = coords[3 * i + 2];
+                cell.first = k;
+                unordered << cell;
+            }
+
+            Cell &cell = unordered.last();
+            cell.last = k + 1;
+            ++cell.mass;
+            cell.center = cell.center + positions[i];
+        }
+    }
+
+    // Put the cells in Morton order, so that the cells of every coarser grid
+    // are runs of the cells below them.
+    QVector<QPair<quint64, int> > order(unordered.size());
+    for (int c = 0; c < unordered.size(); ++c) {
+        const Cell &cell = unordered[c];
+        quint64 code = spreadBits(cell.x) | spreadBits(cell.y) << 1 | spreadBits(cell.z) << 2;
+        order[c] = qMakePair(code, c);
+    }
+    qSort(order);
+
+    cells.resize(unordered.size());
+    cellOf.resize(n);
+    for (int c = 0; c < cells.size(); ++c) {
+        Cell &cell = cells[c];
+        cell = unordered[order[c].second];
+        cell.center = cell.center / (vreal) cell.mass;
+        for (int k = cell.first; k < cell.last; ++k) {
+            cellOf[sorted[k]] = c;
+        }
+    }
+}
+
+void SpatialGrid::buildPyramid() {
+    // Merge pairs of cells along each axis until one cell is left.  Cells
+    // past the range of the Morton code may never merge, so give up after
+    // as many levels as it has bits.
+    QVector<QVector<Cell> > grids;
+    grids << cells;
+    for (int level = 0; grids.last().size() > 1 && level <= MORTON_BITS; ++level) {
+        const QVector<Cell> &below = grids.last();
+        QVector<Cell> above;
+        for (int c = 0; c < below.size(); ++c) {
+            const Cell &child = below[c];
+            int x = child.x >> 1;
+            int y = child.y >> 1;
+            int z = child.z >> 1;
+            if (above.isEmpty() || above.last().x != x || above.last().y != y ||
+                above.last().z != z) {
+                Cell cell;
+                cell.x = x;
+                cell.y = y;
+                cell.z = z;
+                cell.first = c;
+                above << cell;
+            }
+
+            Cell &cell = above.last();
+            cell.last = c + 1;
+            cell.mass += child.mass;
+            cell.center = cell.center + child.center * (vreal) child.mass;
+        }
+
+        for (int c = 0; c < above.size(); ++c) {
+            above[c].center = above[c].center / (vreal) above[c].mass;
+        }
+        grids << above;
+    }
+
+    // The cells of the top grid see each other directly.
+    QVector<Cell> &top = grids.last();
+    QVector<int> start;
+    QVector<int> list;
+    for (int a = 0; a < top.size(); ++a) {
+        start << list.size();
+        for (int b = 0; b < top.size(); ++b) {
+            if (adjacent(top[a].x, top[a].y, top[a].z, top[b].x, top[b].y, top[b].z)) {
+                list << b;
+            } else {
+                top[a].addMonopole(top[b], strength);
+            }
+        }
+    }
+    start << list.size();
+
+    // Going down, the neighbours of a cell are among the children of its
+    // parent's neighbours.  The rest of those children are at least a cell
+    // away and count as monopoles; anything further was already in the
+    // parent's far field, shifted to the cell's center.
+    for (int level = grids.size() - 2; level >= 0; --level) {
+        QVector<Cell> &grid = grids[level];
+        const QVector<Cell> &above = grids[level + 1];
+        QVector<int> gridStart(grid.size() + 1);
+        QVector<int> gridList;
+
+        for (int p = 0; p < above.size(); ++p) {
+            for (int c = above[p].first; c < above[p].last; ++c) {
+                Cell &cell = grid[c];
+                gridStart[c] = gridList.size();
+                cell.addFarField(above[p]);
+
+                for (int n = start[p]; n < start[p + 1]; ++n) {
+                    const Cell &other = above[list[n]];
+                    for (int d = other.first; d < other.last; ++d) {
+                        const Cell &source = grid[d];
+                        if (adjacent(cell.x, cell.y, cell.z, source.x, source.y, source.z)) {
+                            gridList << d;
+                        } else {
+                            cell.addMonopole(source, strength);
+                        }
+                    }
+                }
+            }
+        }
+        gridStart[grid.size()] = gridList.size();
+
+        start = gridStart;
+        list = gridList;
+    }
+
+    cells = grids[0];
+    neighbourStart = start;
+    neighbours = list;
+}
+
+
+// ---------------------------------------------------------------------------
+// SpatialGrid::Cell
+
+SpatialGrid::Cell::Cell() :
+    x(0), y(0), z(0),
+    first(0), last(0),
+    mass(0),
+    center(0.0),
+    force(0.0)
+{
+    for (int k = 0; k < 6; ++k) {
+        gradient[k] = 0;
+    }
+}
+
+void SpatialGrid::Cell::addMonopole(const Cell &source, vreal strength) {
+    const VPointF r = center - source.center;
+    const vreal l = r.lengthSquared();
+    const vreal s = strength * source.mass / l;
+    const vreal t = 2 * s / l;
+
+    force = force + r * s;
+    gradient[0] += s - t * r.x * r.x;
+    gradient[1] += s - t * r.y * r.y;
+    gradient[2] += s - t * r.z * r.z;
+    gradient[3] -= t * r.x * r.y;
+    gradient[4] -= t * r.x * r.z;
+    gradient[5] -= t * r.y * r.z;
+}
+
+void SpatialGrid::Cell::addFarField(const Cell &parent) {
+    force = force + parent.farFieldAt(center);
+    for (int k = 0; k < 6; ++k) {
+        gradient[k] += parent.gradient[k];
+    }
+}
+
+VPointF SpatialGrid::Cell::farFieldAt(const VPointF &p) const {
+    const VPointF d = p - center;
+    return force + VPointF(gradient[0] * d.x + gradient[3] * d.y + gradient[4] * d.z,
+                           gradient[3] * d.x + gradient[1] * d.y + gradient[5] * d.z,
+                           gradient[4] * d.x + gradient[5] * d.y + gradient[2] * d.z);
+}
@@ -0,0 +1,78 @@
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <QVector>
+
+#include "vtools.h"
+
+/* Cutoff repulsion for large graphs.  Nodes are bucketed into a uniform
+ * hash grid whose cells are as wide as the cutoff radius, and the near field
+ * of a node is summed exactly over its own and the neighbouring cells.
+ * Everything further away comes from a pyramid of coarser grids, each cell
+ * twice as wide as the ones below it.  A cell takes the monopoles of the
+ * cells just beyond its neighbours, which its parent's neighbours hold, and
+ * the far field of its parent, so every node is counted exactly once.
+ * The grids are rebuilt from scratch on every call to build().
+ */
+class SpatialGrid
+{
+public:
+    SpatialGrid(vreal cutoff, vreal strength);
+
+    void build(const QVector<VPointF> &positions);
+
+    // The repulsion felt by the i-th position passed to build().
+    VPointF force(int i) const;
+
+    vreal cutoff() const;
+
+    // The largest cutoff used if the graph is sparse enough.
+    static const int DEFAULT_CUTOFF = 150;
+
+private:
+    // Aim for about this many node spacings in the cutoff radius, so the
+    // near field stays O(1) per node even for dense initial placements.
+    static const int NEIGHBOURHOOD = 4;
+
+    // An occupied cell of one of the grids, with coordinates counted from
+    // the lowest cell.  A cell of the finest grid holds the nodes
+    // sorted[first..last), a coarser one the cells first..last-1 below it.
+    // The far field is kept as its value at the center and its gradient,
+    // the symmetric matrix xx, yy, zz, xy, xz, yz.
+    class Cell {
+    public:
+        Cell();
+
+        int x, y, z;
+        int first, last;
+        int mass;
+        VPointF center;
+        VPointF force;
+        vreal gradient[6];
+
+        void addMonopole(const Cell &source, vreal strength);
+        void addFarField(const Cell &parent);
+        VPointF farFieldAt(const VPointF &p) const;
+    };
+
+    vreal maxCutoff;
+    vreal cellWidth;
+    vreal strength;
+
+    QVector<VPointF> positions;
+    QVector<int> sorted;
+    QVector<int> cellOf;
+
+    // The finest grid in Morton order, with the cells next to cell c and c
+    // itself in neighbours[neighbourStart[c]..neighbourStart[c + 1]).
+    QVector<Cell> cells;
+    QVector<int> neighbourStart;
+    QVector<int> neighbours;
+
+    int cellCoord(vreal v) const;
+
+    void buildCells(const VPointF &low);
+    void buildPyramid();
+};
+
+#endif // SPATIALGRID_H
@@ -1,204 +1,1128 @@
 #include "statistics.h"
+#include "compactgraph.h"
 #include "graphscene.h"
 
-#include <QQueue>
-#include <QPointF>
+#include <QSet>
+#include <QThread>
+#include <QtAlgorithms>
+#include <QtConcurrentMap>
+
+#include <math.h>
+
+// Sources are handed out to the threads this many at a time, one bit
+// parallel search each.
+static const int SOURCE_CHUNK = BitParallelSearch::SOURCES;
+
+// The sampled average path length needs at least this many batches of
+// random sources for their variance to mean anything.
+static const int MIN_BATCHES = 8;
+
+// Betweenness sources are handed out to the threads this many at a time.
+static const int DEPENDENCY_CHUNK = 16;
+
+// Power iteration has converged once the scores, which sum to 1, change by
+// less than this in total.
+static const double SCORE_TOLERANCE = 1e-6;
+
+// The chance that PageRank's random walk follows an edge.
+static const double PAGERANK_DAMPING = 0.85;
+
+// Two sided 95% quantile of the normal distribution.
+static const double CONFIDENCE_Z = 1.96;
+
+// The wedge samples are within their error bound with probability
+// 1 - WEDGE_DELTA.
+static const double WEDGE_DELTA = 0.05;
+
+// Uniform in [0, 1), from two draws for enough resolution to pick among
+// billions of wedges.
+static double randomUnit() {
+    return (qrand() + qrand() / (RAND_MAX + 1.0)) / (RAND_MAX + 1.0);
+}
+
+// The vertices with a path to at least one other, which are the only ones
+// worth searching from.
+static QVector<int> connectedVertices(const CompactGraph &graph, const Components &components) {
+    QVector<int> vertices;
+    for (int v(0); v < graph.vertexCount(); ++v) {
+        if (components.size(components.component(v)) > 1) {
+            vertices << v;
+        }
+    }
+    return vertices;
+}
+
+// The scores to iterate from: the given ones, 1 / n for the vertices past
+// their end, all scaled to sum to 1.
+static QVector<double> startingScores(const QVector<double> &start, int n) {
+    QVector<double> scores = start.mid(0, n);
+    const int known = scores.size();
+    scores.resize(n);
+    double sum = 0.0;
+    for (int v(0); v < n; ++v) {
+        if (v >= known) {
+            scores[v] = 1.0 / n;
+        }
+        sum += scores[v];
+    }
+    if (sum > 0.0) {
+        for (int v(0); v < n; ++v) {
+            scores[v] /= sum;
+        }
+    } else {
+        scores.fill(1.0 / n);
+    }
+    return scores;
+}
+
+static double scoreChange(const QVector<double> &before, const QVector<double> &after) {
+    double change = 0.0;
+    for (int v(0); v < before.size(); ++v) {
+        change += qAbs(after[v] - before[v]);
+    }
+    return change;
+}
+
+// Whether a random wedge centred on v is closed; v has degree 2 or more.
+static bool randomWedgeClosed(const CompactGraph &graph, int v) {
+    const int k = graph.degree(v);
+    int a = qrand() % k;
+    int b = qrand() % (k - 1);
+    if (b >= a) {
+        ++b;
+    }
+    const int *neighbours = graph.neighboursBegin(v);
+    return graph.adjacent(neighbours[a], neighbours[b]);
+}
+
+
+// ---------------------------------------------------------------------------
+// Statistics::PathLengths
+
+// One thread of pathStatisticsOf().  Every thread has its own search buffers
+// and takes chunks of sources until there are none left; the results of each
+// chunk go in their own slot, so the totals don't depend on the scheduling.
+class Statistics::PathLengths {
+public:
+    typedef void result_type;
+
+    PathLengths(const CompactGraph &graph, const QVector<int> &sources, StatisticsProgress *progress,
+                QAtomicInt &nextChunk, QVector<qint64> &chunkSums, QVector<int> &chunkDiameters) :
+        graph(graph),
+        sources(sources),
+        progress(progress),
+        nextChunk(nextChunk),
+        chunkSums(chunkSums),
+        chunkDiameters(chunkDiameters)
+    {
+    }
+
+    void operator()(int) {
+        BitParallelSearch search(graph);
+        const int n = sources.size();
+
+        int chunk;
+        while ((chunk = nextChunk.fetchAndAddOrdered(1)) < chunkSums.size()) {
+            if (progress && progress->isCancelled()) {
+                return;
+            }
+
+            int first = chunk * SOURCE_CHUNK;
+            int count = qMin(n - first, (int) SOURCE_CHUNK);
+            search.search(sources.mid(first, count));
+            chunkSums[chunk] = search.distanceSum();
+            chunkDiameters[chunk] = search.maxEccentricity();
+
+            if (progress) {
+                progress->advance(count, n);
+            }
+        }
+    }
+
+private:
+    const CompactGraph &graph;
+    const QVector<int> &sources;
+    StatisticsProgress *progress;
+    QAtomicInt &nextChunk;
+    QVector<qint64> &chunkSums;
+    QVector<int> &chunkDiameters;
+};
+
+
+// ---------------------------------------------------------------------------
+// Statistics::SampledBatch
+
+// A batch of random sources for sampledPathStatisticsOf(), searched at once.
+class Statistics::SampledBatch {
+public:
+    typedef void result_type;
+
+    SampledBatch(const CompactGraph &graph) :
+        graph(graph)
+    {
+    }
+
+    class Batch {
+    public:
+        Batch() : sum(0), diameter(0) { }
+
+        QVector<int> sources;
+        qint64 sum;
+        int diameter;
+    };
+
+    void operator()(Batch &batch) {
+        BitParallelSearch search(graph);
+        search.search(batch.sources);
+        batch.sum = search.distanceSum();
+        batch.diameter = search.maxEccentricity();
+    }
+
+private:
+    const CompactGraph &graph;
+};
+
+
+// ---------------------------------------------------------------------------
+// Statistics::DependencySums
+
+// One thread of betweennessFrom(), adding the dependencies on its chunks of
+// the sources to its own sums.
+class Statistics::DependencySums {
+public:
+    typedef void result_type;
+
+    DependencySums(const CompactGraph &graph, const QVector<int> &sources, StatisticsProgress *progress,
+                   QAtomicInt &nextChunk) :
+        graph(graph),
+        sources(sources),
+        progress(progress),
+        nextChunk(nextChunk)
+    {
+    }
+
+    void operator()(QVector<double> &sums) {
+        Dependencies dependencies(graph);
+        const int chunks = (sources.size() + DEPENDENCY_CHUNK - 1) / DEPENDENCY_CHUNK;
+
+        int chunk;
+        while ((chunk = nextChunk.fetchAndAddOrdered(1)) < chunks) {
+            if (progress && progress->isCancelled()) {
+                return;
+            }
+
+            int first = chunk * DEPENDENCY_CHUNK;
+            int last = qMin(first + DEPENDENCY_CHUNK, sources.size());
+            for (int i(first); i < last; ++i) {
+                dependencies.accumulate(sources[i], sums);
+            }
+
+            if (progress) {
+                progress->advance(last - first, sources.size());
+            }
+        }
+    }
+
+private:
+    const CompactGraph &graph;
+    const QVector<int> &sources;
+    StatisticsProgress *progress;
+    QAtomicInt &nextChunk;
+};
+
+
+// ---------------------------------------------------------------------------
+// Statistics
 
 Statistics::Statistics(GraphScene *scene):
-    graph(scene)
+    graph(scene),
+    degreeSum(0),
+    triangleSum(0),
+    wedgeSum(0),
+    clusteringSum(0.0),
+    components(0),
+    giantSize(0),
+    componentsStale(false)
 {
+    connect(graph, SIGNAL(nodeAdded(Node*)), this, SLOT(onNodeAdded(Node*)));
+    connect(graph, SIGNAL(edgeAdded(Node*,Node*)), this, SLOT(onEdgeAdded(Node*,Node*)));
+    connect(graph, SIGNAL(edgeRemoved(Node*,Node*)), this, SLOT(onEdgeRemoved(Node*,Node*)));
+    connect(graph, SIGNAL(cleared()), this, SLOT(onCleared()));
 }
 
 double Statistics::degreeAvg() {
-    return (2.0 * graph->edges().count()) / graph->nodes().count();
+    return degrees.isEmpty() ? 0.0 : degreeSum / (double) degrees.size();
+}
+
+const QVector<int>& Statistics::degreeHistogram() const {
+    return histogram;
+}
+
+qint64 Statistics::triangles() const {
+    return triangleSum;
+}
+
+CompactGraph Statistics::compactGraph() {
+    if (!snapshot.isValidAt(graph->version())) {
+        snapshot.set(CompactGraph(graph->nodes()), graph->version());
+    }
+    return snapshot.value;
 }
 
 double Statistics::lengthAvg() {
-    double allLengths = 0;
+    return pathStatistics().lengthAvg;
+}
 
-    QSet<Node*> visited;
-    QMap<Node*, int> distance;
-    foreach (Node *n, graph->nodes()) {
-        allLengths += lengthSum(n, visited, distance);
-        foreach (Node *m, graph->nodes()) {
-            distance[m] = 0;
-            visited.remove(m);
-        }
+Statistics::PathStatistics Statistics::pathStatistics() {
+    if (!paths.isValidAt(graph->version())) {
+        paths.set(pathStatisticsOf(compactGraph()), graph->version());
     }
+    return paths.value;
+}
 
-    return allLengths / (double) (graph->nodes().size() * (graph->nodes().size() - 1));
+bool Statistics::hasPathStatistics() const {
+    return paths.isValidAt(graph->version());
 }
 
-double Statistics::clusteringAvg() {
-    double clusterCumulative = 0.0;
+void Statistics::cachePathStatistics(const PathStatistics &result, quint64 version) {
+    if (result.exact && version == graph->version()) {
+        paths.set(result, version);
+    }
+}
+
+Statistics::PathStatistics Statistics::pathStatisticsOf(const CompactGraph &graph, StatisticsProgress *progress) {
+    PathStatistics result;
+    const Components components(graph);
+    const qint64 pairs = components.connectedPairs();
+    if (pairs == 0) {
+        return result;
+    }
+
+    const QVector<int> sources = connectedVertices(graph, components);
+    const int n = sources.size();
+    const int chunks = (n + SOURCE_CHUNK - 1) / SOURCE_CHUNK;
+    QVector<qint64> chunkSums(chunks, 0);
+    QVector<int> chunkDiameters(chunks, 0);
+    QAtomicInt nextChunk(0);
+
+    QVector<int> threads;
+    const int threadCount = qBound(1, QThread::idealThreadCount(), chunks);
+    for (int i(0); i < threadCount; ++i) {
+        threads << i;
+    }
+    QtConcurrent::blockingMap(threads, PathLengths(graph, sources, progress, nextChunk, chunkSums, chunkDiameters));
+
+    if (progress && progress->isCancelled()) {
+        return result;
+    }
 
-    foreach (Node *n, graph->nodes()) {
-        clusterCumulative += clusteringCoeff(n);
+    qint64 allLengths = 0;
+    for (int c(0); c < chunks; ++c) {
+        allLengths += chunkSums[c];
+        result.diameter = qMax(result.diameter, chunkDiameters[c]);
     }
+    result.lengthAvg = allLengths / (double) pairs;
 
-    return clusterCumulative / (double)graph->nodes().size();
+    return result;
+}
 
+int Statistics::diameter() {
+    return diameterStatistics().diameter;
 }
 
-double Statistics::clusteringCoeff(Node *node) {
-    QList<Edge*> edges = node->edges();
-    int k = edges.count();
-    int intersection = 0;
+int Statistics::radius() {
+    return diameterStatistics().radius;
+}
+
+Statistics::DiameterStatistics Statistics::diameterStatistics() {
+    if (!extremes.isValidAt(graph->version())) {
+        extremes.set(diameterStatisticsOf(compactGraph()), graph->version());
+    }
+    return extremes.value;
+}
 
-    while (!edges.empty()) {
-        Edge *e = edges.takeFirst();
-        Node *src = e->sourceNode();
-        Node *dest = e->destNode();
+bool Statistics::hasDiameterStatistics() const {
+    return extremes.isValidAt(graph->version());
+}
 
-        QVector<Node*> nNeigh = node->neighbours();
+void Statistics::cacheDiameterStatistics(const DiameterStatistics &result, quint64 version) {
+    if (version == graph->version()) {
+        extremes.set(result, version);
+    }
+}
 
-        if(src->tag() == node->tag()) {
-            QVector<Node*> dNeigh = dest->neighbours();
-            intersection += intersectionCount(nNeigh, dNeigh);
-        } else {
-            QVector<Node*> dNeigh = src->neighbours();
-            intersection += intersectionCount(nNeigh, dNeigh);
+Statistics::DiameterStatistics Statistics::diameterStatisticsOf(const CompactGraph &graph,
+                                                                StatisticsProgress *progress) {
+    DiameterBounds bounds(graph);
+    while (!bounds.isExact()) {
+        if (progress && progress->isCancelled()) {
+            return DiameterStatistics();
         }
+        bounds.refine();
     }
 
-    return k > 1 ? (2*intersection) / (double) (k*(k-1)) : 0 ;
+    DiameterStatistics result;
+    result.diameter = bounds.diameter();
+    result.radius = bounds.radius();
+    result.searches = bounds.searches();
+    return result;
 }
 
-double Statistics::clusteringDegree(int degree) {
-    QList<Node*> nodeList = graph->getDegreeList(degree);
-    int degreeCount = nodeList.count();
-    int clusterCumulative = 0;
+QVector<double> Statistics::betweennessOf(const CompactGraph &graph, StatisticsProgress *progress) {
+    // Every pair is counted from both of its ends.
+    return betweennessFrom(graph, connectedVertices(graph, Components(graph)), 0.5, progress);
+}
 
-    foreach (Node *n, nodeList) {
-        clusterCumulative += clusteringCoeff(n);
+QVector<double> Statistics::sampledBetweennessOf(const CompactGraph &graph, int sources,
+                                                 StatisticsProgress *progress) {
+    QVector<int> candidates = connectedVertices(graph, Components(graph));
+    if (sources >= candidates.size()) {
+        return betweennessFrom(graph, candidates, 0.5, progress);
     }
 
-    return clusterCumulative / degreeCount;
+    // The first few of a random shuffle
+    for (int i(0); i < sources; ++i) {
+        qSwap(candidates[i], candidates[i + qrand() % (candidates.size() - i)]);
+    }
+    double scale = 0.5 * candidates.size() / sources;
+    candidates.resize(sources);
+    return betweennessFrom(graph, candidates, scale, progress);
 }
 
+QVector<double> Statistics::betweennessFrom(const CompactGraph &graph, const QVector<int> &sources,
+                                            double scale, StatisticsProgress *progress) {
+    const int n = graph.vertexCount();
+    const int threadCount = qBound(1, QThread::idealThreadCount(),
+                                   qMax(1, (sources.size() + DEPENDENCY_CHUNK - 1) / DEPENDENCY_CHUNK));
+    QVector<QVector<double> > threadSums(threadCount, QVector<double>(n, 0.0));
+    QAtomicInt nextChunk(0);
+    QtConcurrent::blockingMap(threadSums, DependencySums(graph, sources, progress, nextChunk));
+
+    if (progress && progress->isCancelled()) {
+        return QVector<double>();
+    }
 
-double Statistics::lengthSum(Node *s, QSet<Node*> &visited, QMap<Node*, int> &distance) {
-    QQueue<Node*> queue;
-    queue.append(s);
-    double retLength = 0;
-    visited.insert(s);
+    QVector<double> betweenness(n, 0.0);
+    foreach (const QVector<double> &sums, threadSums) {
+        for (int v(0); v < n; ++v) {
+            betweenness[v] += sums[v];
+        }
+    }
+    for (int v(0); v < n; ++v) {
+        betweenness[v] *= scale;
+    }
+    return betweenness;
+}
 
-    // Find the distances to all other nodes using breadth first search
-    while(!queue.empty()) {
-        Node *parent = queue.dequeue();
-        QList<Edge*> edges = parent->edges();
+Statistics::PathStatistics Statistics::sampledPathStatisticsOf(const CompactGraph &graph, double relativeError,
+                                                              StatisticsProgress *progress) {
+    const Components components(graph);
+    const QVector<int> sources = connectedVertices(graph, components);
+    const int n = sources.size();
+    if (n <= MIN_BATCHES * SOURCE_CHUNK) {
+        return pathStatisticsOf(graph, progress);
+    }
+    const qint64 pairs = components.connectedPairs();
 
-        foreach(Edge *e, edges) {
-            Node *n;
+    PathStatistics result;
+    result.exact = false;
+
+    const int threadCount = qMax(1, QThread::idealThreadCount());
+    const int maxBatches = qMax(MIN_BATCHES, n / SOURCE_CHUNK);
+
+    // Every batch's mean length is an independent sample of the average:
+    // its sources stand for all n of them, and their searches for all of
+    // the connected pairs.
+    QVector<double> means;
+    while (means.size() < maxBatches) {
+        if (progress && progress->isCancelled()) {
+            return PathStatistics();
+        }
+
+        QVector<SampledBatch::Batch> batches(qMin(threadCount, maxBatches - means.size()));
+        for (int b(0); b < batches.size(); ++b) {
+            QSet<int> picked;
+            while (picked.size() < SOURCE_CHUNK) {
+                int v = sources[qrand() % n];
+                if (!picked.contains(v)) {
+                    picked.insert(v);
+                    batches[b].sources << v;
+                }
+            }
+        }
+        QtConcurrent::blockingMap(batches, SampledBatch(graph));
+
+        foreach (const SampledBatch::Batch &batch, batches) {
+            means << batch.sum * ((double) n / SOURCE_CHUNK) / pairs;
+            result.diameter = qMax(result.diameter, batch.diameter);
+        }
+        if (progress) {
+            progress->advance(batches.size(), maxBatches);
+        }
 
-            if(e->sourceNode()->tag() == parent->tag()) {
-                n = e->destNode();
+        if (means.size() < MIN_BATCHES) {
+            continue;
+        }
+
+        double sum = 0.0;
+        foreach (double mean, means) {
+            sum += mean;
+        }
+        result.lengthAvg = sum / means.size();
+
+        double squares = 0.0;
+        foreach (double mean, means) {
+            squares += (mean - result.lengthAvg) * (mean - result.lengthAvg);
+        }
+        double variance = squares / (means.size() - 1);
+        result.lengthError = CONFIDENCE_Z * sqrt(variance / means.size());
+
+        if (result.lengthError <= relativeError * result.lengthAvg) {
+            break;
+        }
+    }
+
+    return result;
+}
+
+Statistics::CommunityStatistics Statistics::communityStatistics() {
+    if (!partition.isValidAt(graph->version())) {
+        partition.set(communityStatisticsOf(compactGraph()), graph->version());
+    }
+    return partition.value;
+}
+
+bool Statistics::hasCommunityStatistics() const {
+    return partition.isValidAt(graph->version());
+}
+
+void Statistics::cacheCommunityStatistics(const CommunityStatistics &result, quint64 version) {
+    if (version == graph->version()) {
+        partition.set(result, version);
+    }
+}
+
+Statistics::CommunityStatistics Statistics::communityStatisticsOf(const CompactGraph &graph,
+                                                                  StatisticsProgress *progress) {
+    Communities communities(graph);
+    do {
+        if (progress && progress->isCancelled()) {
+            return CommunityStatistics();
+        }
+    } while (communities.refine());
+
+    CommunityStatistics result;
+    for (int v(0); v < graph.vertexCount(); ++v) {
+        result.communities << communities.community(v);
+    }
+    result.count = communities.count();
+    result.modularity = communities.modularity();
+    result.levels = communities.levels();
+    return result;
+}
+
+Statistics::VertexScores Statistics::pageRankOf(const CompactGraph &graph, const QVector<double> &start,
+                                                StatisticsProgress *progress) {
+    VertexScores result;
+    const int n = graph.vertexCount();
+    if (n == 0) {
+        return result;
+    }
+
+    const AdjacencyProduct adjacency(graph);
+    QVector<double> ranks = startingScores(start, n);
+    QVector<double> shares(n);
+    QVector<double> gathered(n);
+    while (!result.converged && result.iterations < MAX_ITERATIONS) {
+        if (progress && progress->isCancelled()) {
+            return VertexScores();
+        }
+
+        // Each vertex shares its rank out between its neighbours, and an
+        // isolated one between every vertex.
+        double isolated = 0.0;
+        for (int v(0); v < n; ++v) {
+            const int k = graph.degree(v);
+            if (k > 0) {
+                shares[v] = ranks[v] / k;
             } else {
-                n = e->sourceNode();
+                shares[v] = 0.0;
+                isolated += ranks[v];
             }
+        }
+        adjacency.multiply(shares, gathered);
+
+        const double jump = (1.0 - PAGERANK_DAMPING + PAGERANK_DAMPING * isolated) / n;
+        for (int v(0); v < n; ++v) {
+            gathered[v] = jump + PAGERANK_DAMPING * gathered[v];
+        }
+        result.converged = scoreChange(ranks, gathered) < SCORE_TOLERANCE;
+        qSwap(ranks, gathered);
+        ++result.iterations;
+        if (progress) {
+            progress->advance(1, MAX_ITERATIONS);
+        }
+    }
+
+    result.scores = ranks;
+    return result;
+}
+
+Statistics::VertexScores Statistics::eigenvectorCentralityOf(const CompactGraph &graph,
+                                                             const QVector<double> &start,
+                                                             StatisticsProgress *progress) {
+    VertexScores result;
+    const int n = graph.vertexCount();
+    if (n == 0) {
+        return result;
+    }
+
+    const AdjacencyProduct adjacency(graph);
+    QVector<double> scores = startingScores(start, n);
+    QVector<double> product(n);
+    while (!result.converged && result.iterations < MAX_ITERATIONS) {
+        if (progress && progress->isCancelled()) {
+            return VertexScores();
+        }
+
+        adjacency.multiply(scores, product);
+        double sum = 0.0;
+        for (int v(0); v < n; ++v) {
+            product[v] += scores[v];
+            sum += product[v];
+        }
+        for (int v(0); v < n; ++v) {
+            product[v] /= sum;
+        }
+        result.converged = scoreChange(scores, product) < SCORE_TOLERANCE;
+        qSwap(scores, product);
+        ++result.iterations;
+        if (progress) {
+            progress->advance(1, MAX_ITERATIONS);
+        }
+    }
+
+    result.scores = scores;
+    return result;
+}
+
+Statistics::VertexScores Statistics::pageRank() {
+    if (!ranks.isValidAt(graph->version())) {
+        ranks.set(pageRankOf(compactGraph(), ranks.value.scores), graph->version());
+    }
+    return ranks.value;
+}
+
+Statistics::VertexScores Statistics::eigenvectorCentrality() {
+    if (!eigenvector.isValidAt(graph->version())) {
+        eigenvector.set(eigenvectorCentralityOf(compactGraph(), eigenvector.value.scores), graph->version());
+    }
+    return eigenvector.value;
+}
+
+const QVector<int>& Statistics::coreNumbers() {
+    if (!cores.isValidAt(graph->version())) {
+        cores.set(coreNumbersOf(compactGraph()), graph->version());
+    }
+    return cores.value;
+}
+
+int Statistics::maxCore() {
+    int most = 0;
+    foreach (int core, coreNumbers()) {
+        most = qMax(most, core);
+    }
+    return most;
+}
 
-            if(!visited.contains(n)) {
-                visited.insert(n);
-                distance[n] = distance.value(parent, 0) + 1;
-                queue.enqueue(n);
+QVector<int> Statistics::coreNumbersOf(const CompactGraph &graph) {
+    const int n = graph.vertexCount();
+    QVector<int> degrees(n);
+    int maxDegree = 0;
+    for (int v(0); v < n; ++v) {
+        degrees[v] = graph.degree(v);
+        maxDegree = qMax(maxDegree, degrees[v]);
+    }
+
+    // The vertices sorted by degree, where each degree's bucket starts, and
+    // where each vertex is.
+    QVector<int> buckets(maxDegree + 1, 0);
+    foreach (int k, degrees) {
+        ++buckets[k];
+    }
+    for (int k(0), start(0); k <= maxDegree; ++k) {
+        int size = buckets[k];
+        buckets[k] = start;
+        start += size;
+    }
+    QVector<int> order(n);
+    QVector<int> positions(n);
+    for (int v(0); v < n; ++v) {
+        positions[v] = buckets[degrees[v]]++;
+        order[positions[v]] = v;
+    }
+    for (int k(maxDegree); k > 0; --k) {
+        buckets[k] = buckets[k - 1];
+    }
+    buckets[0] = 0;
+
+    // Once taken, a vertex's degree is its core number.  A neighbour with a
+    // higher degree swaps with the first vertex of its bucket, which then
+    // starts one place later, and so moves down into the bucket below.
+    for (int i(0); i < n; ++i) {
+        const int v = order[i];
+        const int *end = graph.neighboursEnd(v);
+        for (const int *u = graph.neighboursBegin(v); u != end; ++u) {
+            const int k = degrees[*u];
+            if (k <= degrees[v]) {
+                continue;
+            }
+            const int first = buckets[k];
+            const int w = order[first];
+            if (w != *u) {
+                order[positions[*u]] = w;
+                positions[w] = positions[*u];
+                order[first] = *u;
+                positions[*u] = first;
             }
+            ++buckets[k];
+            --degrees[*u];
+        }
+    }
+
+    return degrees;
+}
+
+double Statistics::clusteringAvg() {
+    return degrees.isEmpty() ? 0.0 : clusteringSum / degrees.size();
+}
+
+double Statistics::clusteringCoeff(Node *node) {
+    if (!index.contains(node)) {
+        return 0.0;
+    }
+    return localClustering(index.value(node));
+}
 
+double Statistics::clusteringDegree(int degree) {
+    double clusterCumulative = 0.0;
+    int degreeCount = 0;
+    for (int v(0); v < degrees.size(); ++v) {
+        if (degrees[v] == degree) {
+            clusterCumulative += localClustering(v);
+            ++degreeCount;
         }
+    }
+
+    return (degreeCount > 0) ? clusterCumulative / degreeCount : 0.0;
+}
 
-        retLength += distance[parent];
+double Statistics::transitivity() {
+    return (wedgeSum > 0) ? (3.0 * triangleSum) / wedgeSum : 0.0;
+}
+
+int Statistics::componentCount() {
+    if (componentsStale) {
+        rebuildComponents();
     }
+    return components;
+}
 
-    return retLength;
+int Statistics::giantComponentSize() {
+    if (componentsStale) {
+        rebuildComponents();
+    }
+    return giantSize;
 }
 
-int Statistics::intersectionCount(QVector<Node*> vec1, QVector<Node*> vec2) {
-    QVector<Node*> retVec;
-    QVector<Node*> *shorterVec;
-    QVector<Node*> *longerVec;
+Statistics::ClusteringStatistics Statistics::clusteringStatisticsOf(const CompactGraph &graph) {
+    TriangleCount triangles(graph);
+    triangles.count();
+
+    ClusteringStatistics result;
+    result.clusteringAvg = triangles.clusteringAvg();
+    result.transitivity = triangles.transitivity();
+    return result;
+}
 
-    // tags are unqiue, so no counter is needed
-    QMap<int,bool> mapShort;
-    QMap<int,bool> mapLong;
+Statistics::ClusteringStatistics Statistics::sampledClusteringStatisticsOf(const CompactGraph &graph,
+                                                                          int samples) {
+    ClusteringStatistics result;
+    const int n = graph.vertexCount();
+    if (n == 0 || samples <= 0) {
+        return result;
+    }
+    result.exact = false;
+    result.error = sqrt(log(2 / WEDGE_DELTA) / (2.0 * samples));
 
+    // The average clustering is the chance that a random wedge at a
+    // uniformly random vertex is closed; vertices without one count as 0.
+    int closed = 0;
+    for (int i(0); i < samples; ++i) {
+        int v = qrand() % n;
+        if (graph.degree(v) > 1 && randomWedgeClosed(graph, v)) {
+            ++closed;
+        }
+    }
+    result.clusteringAvg = closed / (double) samples;
 
-    int length;
-    int shortLength;
-    if (vec1.size() > vec2.size()) {
-        length = vec1.size();
-        shortLength = vec2.size();
-        shorterVec = &vec2;
-        longerVec = &vec1;
-    } else {
-       length = vec2.size();
-       shortLength = vec1.size();
-       shorterVec = &vec1;
-       longerVec = &vec2;
+    // The transitivity is the chance that a uniformly random wedge is
+    // closed, so its centre is picked in proportion to its wedges.
+    QVector<qint64> wedges(n + 1, 0);
+    for (int v(0); v < n; ++v) {
+        qint64 k = graph.degree(v);
+        wedges[v + 1] = wedges[v] + k * (k - 1) / 2;
+    }
+    if (wedges[n] == 0) {
+        return result;
     }
 
-    if (shortLength == 0) {
-        return 0;
+    closed = 0;
+    for (int i(0); i < samples; ++i) {
+        qint64 wedge = qMin((qint64) (randomUnit() * wedges[n]), wedges[n] - 1);
+        int v = qUpperBound(wedges.constBegin(), wedges.constEnd(), wedge) - wedges.constBegin() - 1;
+        if (randomWedgeClosed(graph, v)) {
+            ++closed;
+        }
     }
+    result.transitivity = closed / (double) samples;
 
-    for (int i(0); i < length; ++i) {
-        Node *longPointer;
-        Node *shortPointer;
+    return result;
+}
 
-        if (i < shortLength) {
-            shortPointer = shorterVec->at(i);
-            mapShort.insert(shortPointer->tag(), true);
+void Statistics::onNodeAdded(Node *node) {
+    index.insert(node, degrees.size());
+    degrees << 0;
+    nodeTriangles << 0;
+    if (histogram.isEmpty()) {
+        histogram << 0;
+    }
+    ++histogram[0];
 
+    parent << parent.size();
+    componentSizes << 1;
+    ++components;
+    giantSize = qMax(giantSize, 1);
+}
+
+void Statistics::onEdgeAdded(Node *source, Node *dest) {
+    int u = index.value(source);
+    int v = index.value(dest);
+
+    int closed = commonNeighbours(source, dest, 1);
+    changeVertex(u, 1, closed);
+    changeVertex(v, 1, closed);
+    triangleSum += closed;
+    degreeSum += 2;
+
+    if (!componentsStale) {
+        joinComponents(u, v);
+    }
+}
+
+void Statistics::onEdgeRemoved(Node *source, Node *dest) {
+    int u = index.value(source);
+    int v = index.value(dest);
+
+    int opened = commonNeighbours(source, dest, -1);
+    changeVertex(u, -1, -opened);
+    changeVertex(v, -1, -opened);
+    triangleSum -= opened;
+    degreeSum -= 2;
+
+    componentsStale = true;
+}
+
+void Statistics::onCleared() {
+    index.clear();
+    degrees.clear();
+    nodeTriangles.clear();
+    histogram.clear();
+    degreeSum = 0;
+    triangleSum = 0;
+    wedgeSum = 0;
+    clusteringSum = 0.0;
+
+    parent.clear();
+    componentSizes.clear();
+    components = 0;
+    giantSize = 0;
+    componentsStale = false;
+
+    // Nothing like the next graph to start from.
+    ranks = Cached<VertexScores>();
+    eigenvector = Cached<VertexScores>();
+}
+
+double Statistics::localClustering(int v) const {
+    qint64 k = degrees[v];
+    return (k > 1) ? (2.0 * nodeTriangles[v]) / (k * (k - 1)) : 0.0;
+}
+
+// Keeps the sums and the histogram in step with one node's counts.
+void Statistics::changeVertex(int v, int degreeChange, int triangleChange) {
+    clusteringSum -= localClustering(v);
+
+    if (degreeChange != 0) {
+        qint64 k = degrees[v];
+        wedgeSum -= k * (k - 1) / 2;
+        --histogram[k];
+
+        k += degreeChange;
+        degrees[v] = k;
+        wedgeSum += k * (k - 1) / 2;
+        if (k >= histogram.size()) {
+            histogram.resize(k + 1);
         }
+        ++histogram[k];
+    }
+    nodeTriangles[v] += triangleChange;
 
-        longPointer= longerVec->at(i);
+    clusteringSum += localClustering(v);
+}
 
-        mapLong.insert(longPointer->tag(), true);
+// Counts the triangles the edge between the two nodes closes, and changes
+// the counts of their third corners.  Only the neighbours of the end with
+// fewer edges are looked at.
+int Statistics::commonNeighbours(Node *source, Node *dest, int triangleChange) {
+    if (dest->edges().size() < source->edges().size()) {
+        qSwap(source, dest);
+    }
 
-        // if it contains its true
-        if (mapShort.contains(longPointer->tag())) {
-            retVec << longPointer;
-            //don'thave to clear maps because tags are unique
+    int common = 0;
+    foreach (Edge *e, source->edges()) {
+        Node *other = (e->sourceNode() == source) ? e->destNode() : e->sourceNode();
+        if (other != dest && graph->doesEdgeExist(other, dest)) {
+            changeVertex(index.value(other), 0, triangleChange);
+            ++common;
         }
     }
+    return common;
+}
+
+int Statistics::findComponent(int v) {
+    while (parent[v] != v) {
+        parent[v] = parent[parent[v]];
+        v = parent[v];
+    }
+    return v;
+}
 
-    return retVec.size();
+void Statistics::joinComponents(int u, int v) {
+    u = findComponent(u);
+    v = findComponent(v);
+    if (u != v) {
+        if (componentSizes[u] < componentSizes[v]) {
+            qSwap(u, v);
+        }
+        parent[v] = u;
+        componentSizes[u] += componentSizes[v];
+        giantSize = qMax(giantSize, componentSizes[u]);
+        --components;
+    }
 }
 
+void Statistics::rebuildComponents() {
+    for (int v(0); v < parent.size(); ++v) {
+        parent[v] = v;
+    }
+    componentSizes.fill(1);
+    components = parent.size();
+    giantSize = qMin(parent.size(), 1);
+    componentsStale = false;
+
+    foreach (Edge *e, graph->edges()) {
+        joinComponents(index.value(e->sourceNode()), index.value(e->destNode()));
+    }
+}
 
 double Statistics::powerLawExponent() {
-    //Made a list here incase we want to plot the data in a widget.
-    QList<QPointF> plot;
+    return powerLawFit().exponent;
+}
+
+Statistics::PowerLawFit Statistics::powerLawFit() {
+    if (!fit.isValidAt(graph->version())) {
+        fit.set(powerLawFitOf(histogram), graph->version());
+    }
+    return fit.value;
+}
 
-    int maxDegree = graph->maxDegree();
+Statistics::PowerLawFit Statistics::powerLawFitOf(const QVector<int> &histogram) {
+    PowerLawFit result;
+    const int kmax = histogram.size() - 1;
+    if (kmax < 1) {
+        return result;
+    }
 
-    for (double i(0); i < maxDegree; ++i) {
-        double count = graph->nodeCount(i);
-        double y = count / (double)graph->nodes().size();
+    // The nodes of degree k and up, and the sum of their log degrees, so
+    // that the likelihood is maximised in O(1) for each xmin.
+    QVector<qint64> tail(kmax + 2, 0);
+    QVector<double> logSum(kmax + 2, 0.0);
+    for (int k(kmax); k >= 1; --k) {
+        tail[k] = tail[k + 1] + histogram[k];
+        logSum[k] = logSum[k + 1] + histogram[k] * log((double) k);
+    }
 
-        if (y != 0) {
-            // incase we want to plot
-            QPointF p(qLn(i+1), qLn(y));
-            plot << p;
+    // The degrees some node has, lowest first.
+    QVector<int> degrees;
+    for (int k(1); k <= kmax; ++k) {
+        if (histogram[k] > 0) {
+            degrees << k;
         }
     }
 
-    double deltaY = 0.0;
-    double deltaX = 0.0;
-    double yPref;
-    int c = 0;
+    for (int first(0); first < degrees.size() && tail[degrees[first]] >= MIN_TAIL; ++first) {
+        const int xmin = degrees[first];
 
-    foreach (QPointF p, plot) {
-        // init calculation
-        if (c == 0) {
-           yPref = p.ry();
-           deltaX = p.rx();
-           ++c;
-        } else {
-            deltaY += p.ry() - yPref;
-            yPref = p.ry();
-            deltaX = p.rx() - deltaX;
-            ++c;
+        // Clauset, Shalizi and Newman's approximation to the discrete
+        // estimator.
+        const double shift = log(xmin - 0.5);
+        const double exponent = 1.0 + tail[xmin] / (logSum[xmin] - tail[xmin] * shift);
+
+        // Against the fit's complementary distribution, approximated the
+        // same way.  The observed one only steps down past an observed
+        // degree and the fitted one falls throughout, so the largest gap is
+        // at an observed degree or the one just above it.
+        double distance = 0.0;
+        for (int i(first); i < degrees.size(); ++i) {
+            for (int k(degrees[i]); k <= qMin(degrees[i] + 1, kmax); ++k) {
+                double observed = tail[k] / (double) tail[xmin];
+                double fitted = exp((1.0 - exponent) * (log(k - 0.5) - shift));
+                distance = qMax(distance, fabs(observed - fitted));
+            }
+        }
+
+        if (result.tailSize == 0 || distance < result.distance) {
+            result.exponent = exponent;
+            result.xmin = xmin;
+            result.distance = distance;
+            result.tailSize = tail[xmin];
         }
     }
 
-    return (-1) * (deltaY / deltaX);
+    return result;
+}
+
+
+// ---------------------------------------------------------------------------
+// Statistics::PathStatistics
+
+Statistics::PathStatistics::PathStatistics() :
+    lengthAvg(0.0),
+    lengthError(0.0),
+    diameter(0),
+    exact(true)
+{
+}
+
+
+// ---------------------------------------------------------------------------
+// Statistics::ClusteringStatistics
+
+Statistics::ClusteringStatistics::ClusteringStatistics() :
+    clusteringAvg(0.0),
+    transitivity(0.0),
+    error(0.0),
+    exact(true)
+{
+}
+
+
+// ---------------------------------------------------------------------------
+// Statistics::DiameterStatistics
+
+Statistics::DiameterStatistics::DiameterStatistics() :
+    diameter(0),
+    radius(0),
+    searches(0)
+{
+}
+
+
+// ---------------------------------------------------------------------------
+// Statistics::CommunityStatistics
+
+Statistics::CommunityStatistics::CommunityStatistics() :
+    count(0),
+    modularity(0.0),
+    levels(0)
+{
+}
+
+
+// ---------------------------------------------------------------------------
+// Statistics::VertexScores
+
+Statistics::VertexScores::VertexScores() :
+    iterations(0),
+    converged(false)
+{
+}
+
+
+// ---------------------------------------------------------------------------
+// Statistics::PowerLawFit
+
+Statistics::PowerLawFit::PowerLawFit() :
+    exponent(0.0),
+    xmin(0),
+    distance(0.0),
+    tailSize(0)
+{
+}
+
+
+// ---------------------------------------------------------------------------
+// StatisticsProgress
+
+StatisticsProgress::StatisticsProgress(QObject *parent) :
+    QObject(parent),
+    cancelled(0),
+    done(0)
+{
+}
+
+bool StatisticsProgress::isCancelled() const {
+    return cancelled != 0;
+}
+
+void StatisticsProgress::advance(int count, int total) {
+    emit progress(done.fetchAndAddOrdered(count) + count, total);
+}
+
+void StatisticsProgress::cancel() {
+    cancelled.fetchAndStoreOrdered(1);
+}
+
+
+// ---------------------------------------------------------------------------
+// StatisticsJob
+
+StatisticsJob::StatisticsJob(QObject *parent) :
+    QObject(parent),
+    myProgress(new StatisticsProgress(this)),
+    isCancelled(false)
+{
+    connect(myProgress, SIGNAL(progress(int,int)), this, SIGNAL(progress(int,int)));
+}
+
+StatisticsProgress* StatisticsJob::progress() const {
+    return myProgress;
+}
+
+void StatisticsJob::cancel() {
+    isCancelled = true;
+    myProgress->cancel();
+    disconnect(this, 0, 0, 0);
+}
+
+void StatisticsJob::watch(QFutureWatcherBase *watcher) {
+    connect(watcher, SIGNAL(finished()), this, SLOT(onComputed()));
+}
+
+void StatisticsJob::onComputed() {
+    if (!isCancelled) {
+        emit finished();
+    }
+    deleteLater();
 }
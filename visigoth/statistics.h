@@ -1,35 +1,386 @@
 #ifndef STATISTICS_H
 #define STATISTICS_H
 
+#include "compactgraph.h"
 #include "edge.h"
 #include "node.h"
 
+#include <QAtomicInt>
+#include <QFutureWatcher>
+#include <QHash>
 #include <QList>
 #include <QMap>
+#include <QObject>
 #include <QSet>
 #include <QVector>
 #include <QtCore/qmath.h>
 
 class GraphScene;
 
-class Statistics {
+/* Reports how far a long statistic running on another thread has got, and
+ * lets it be cancelled from any thread.
+ */
+class StatisticsProgress : public QObject {
+    Q_OBJECT
+public:
+    explicit StatisticsProgress(QObject *parent = 0);
+
+    bool isCancelled() const;
+
+    // Called by the computation as it gets through count more of its total
+    // steps; emits progress().
+    void advance(int count, int total);
+
+public slots:
+    void cancel();
+
+signals:
+    void progress(int done, int total);
+
+private:
+    QAtomicInt cancelled;
+    QAtomicInt done;
+};
+
+/* A statistic computed on the global thread pool.  finished() is emitted
+ * on the thread the job was made on, after which the job deletes itself;
+ * a cancelled job lets its computation wind down and deletes itself
+ * without emitting anything.
+ */
+class StatisticsJob : public QObject {
+    Q_OBJECT
+public:
+    explicit StatisticsJob(QObject *parent = 0);
+
+    // For the computation to check and report to.
+    StatisticsProgress* progress() const;
+
+    void cancel();
+
+signals:
+    void progress(int done, int total);
+    void finished();
+
+protected:
+    void watch(QFutureWatcherBase *watcher);
+
+private slots:
+    void onComputed();
+
+private:
+    StatisticsProgress *myProgress;
+    bool isCancelled;
+};
+
+/* A StatisticsJob with a result of type T, read from the slot connected
+ * to finished():
+ *
+ *     job->setFuture(QtConcurrent::run(&f, graph, job->progress()));
+ */
+template <typename T>
+class StatisticsTask : public StatisticsJob {
+public:
+    explicit StatisticsTask(QObject *parent = 0) :
+        StatisticsJob(parent),
+        watcher(new QFutureWatcher<T>(this))
+    {
+        watch(watcher);
+    }
+
+    void setFuture(const QFuture<T> &future) {
+        watcher->setFuture(future);
+    }
+
+    T result() const {
+        return watcher->result();
+    }
+
+private:
+    QFutureWatcher<T> *watcher;
+};
+
+/* Statistics of a GraphScene.  The degrees, triangles and components are
+ * kept up to date as the scene's edges are added and removed, so the
+ * averages that depend only on them are cheap to read at any time; the
+ * rest are computed from scratch on a CompactGraph.
+ */
+class Statistics : public QObject {
+    Q_OBJECT
 public:
     Statistics(GraphScene* scene);
 
+    // The statistics that need a search from every vertex.  Pairs of
+    // vertices with no path between them are left out of both, so the
+    // average is over the pairs within each component, and no search
+    // starts from an isolated vertex.
+    class PathStatistics {
+    public:
+        PathStatistics();
+
+        double lengthAvg;
+        // Half the width of the 95% confidence interval of a sampled
+        // average, 0 if it is exact.
+        double lengthError;
+        // When sampled, the largest eccentricity of the sources searched,
+        // which is only a lower bound on the diameter.
+        int diameter;
+        bool exact;
+    };
+
+    // The clustering coefficients, counted exactly or estimated from random
+    // paths of length two (wedges), which are closed if their ends are
+    // neighbours.
+    class ClusteringStatistics {
+    public:
+        ClusteringStatistics();
+
+        double clusteringAvg;
+        double transitivity;
+        // With 95% confidence, both are within this of their true value;
+        // 0 if exact.
+        double error;
+        bool exact;
+    };
+
+    // The diameter and radius of the largest component; see DiameterBounds.
+    class DiameterStatistics {
+    public:
+        DiameterStatistics();
+
+        int diameter;
+        int radius;
+        // The vertices it searched from.
+        int searches;
+    };
+
+    // A score for every vertex from power iteration.
+    class VertexScores {
+    public:
+        VertexScores();
+
+        QVector<double> scores;
+        int iterations;
+        // Whether they changed by less than a millionth in total on the
+        // last iteration, before MAX_ITERATIONS.
+        bool converged;
+    };
+
+    // Communities found by the Louvain method; see Communities.
+    class CommunityStatistics {
+    public:
+        CommunityStatistics();
+
+        // The community of every vertex, numbered from 0.
+        QVector<int> communities;
+        int count;
+        double modularity;
+        int levels;
+    };
+
+    // A discrete power law fitted by maximum likelihood to the degrees from
+    // xmin up, where xmin is the one whose fit is closest to the data.
+    class PowerLawFit {
+    public:
+        PowerLawFit();
+
+        double exponent;
+        int xmin;
+        // Kolmogorov-Smirnov distance between the tail and the fit.
+        double distance;
+        int tailSize;
+    };
+
+    // The graph as it is now.  Every result computed on the whole graph is
+    // kept until GraphScene::version() changes.
+    CompactGraph compactGraph();
+
     double degreeAvg();
     double lengthAvg();
+    PathStatistics pathStatistics();
+    bool hasPathStatistics() const;
+    // Keeps an exact result computed elsewhere on the given version of the
+    // graph, if it is still the current one.
+    void cachePathStatistics(const PathStatistics &result, quint64 version);
+    // Searches from every vertex, many sources at a time and in parallel.
+    // It is safe to call on any thread, and returns zeroes if cancelled.
+    static PathStatistics pathStatisticsOf(const CompactGraph &graph, StatisticsProgress *progress = 0);
+
+    // Estimates the average length from batches of random sources until the
+    // confidence interval is within relativeError of it.
+    static PathStatistics sampledPathStatisticsOf(const CompactGraph &graph, double relativeError,
+                                                  StatisticsProgress *progress = 0);
+
+    // Graphs larger than this are better off sampled.
+    static const int SAMPLING_THRESHOLD = 50000;
+
+    int diameter();
+    int radius();
+    DiameterStatistics diameterStatistics();
+    bool hasDiameterStatistics() const;
+    void cacheDiameterStatistics(const DiameterStatistics &result, quint64 version);
+    // Safe to call on any thread; returns zeroes if cancelled.
+    static DiameterStatistics diameterStatisticsOf(const CompactGraph &graph, StatisticsProgress *progress = 0);
+
+    // For every vertex, the shortest paths between pairs of other vertices
+    // that pass through it, each pair's shared out evenly between its
+    // shortest paths.  Brandes' algorithm, from every vertex in parallel;
+    // returns an empty vector if cancelled.
+    static QVector<double> betweennessOf(const CompactGraph &graph, StatisticsProgress *progress = 0);
+    // Only searches from the given number of random sources, and scales
+    // their sums up to estimate the whole.
+    static QVector<double> sampledBetweennessOf(const CompactGraph &graph, int sources,
+                                                StatisticsProgress *progress = 0);
+
+    // Graphs larger than this are better off sampled, from this many
+    // sources.
+    static const int BETWEENNESS_THRESHOLD = 5000;
+    static const int BETWEENNESS_SOURCES = 1000;
+
+    CommunityStatistics communityStatistics();
+    bool hasCommunityStatistics() const;
+    void cacheCommunityStatistics(const CommunityStatistics &result, quint64 version);
+    // Safe to call on any thread; returns no communities if cancelled.
+    static CommunityStatistics communityStatisticsOf(const CompactGraph &graph,
+                                                     StatisticsProgress *progress = 0);
+
+    // The chance of a random walk being at each vertex, when at every step
+    // it follows a random edge with probability 0.85 and otherwise jumps
+    // to a random vertex; they sum to 1.  Iterates from the given scores,
+    // those of vertices past its end being 1 / n, or from 1 / n for every
+    // vertex without any.  Returns no scores if cancelled.
+    static VertexScores pageRankOf(const CompactGraph &graph, const QVector<double> &start = QVector<double>(),
+                                   StatisticsProgress *progress = 0);
+    // The eigenvector of the adjacency matrix's largest eigenvalue, scaled
+    // to sum to 1.  Iterating with the matrix plus the identity has the
+    // same eigenvectors, and still converges on bipartite graphs.
+    static VertexScores eigenvectorCentralityOf(const CompactGraph &graph,
+                                                const QVector<double> &start = QVector<double>(),
+                                                StatisticsProgress *progress = 0);
+
+    static const int MAX_ITERATIONS = 1000;
+
+    // Of the graph as it is now, iterated from the last scores computed, so
+    // that after adding a few nodes they take only a few iterations.
+    VertexScores pageRank();
+    VertexScores eigenvectorCentrality();
+
+    // The core number of every node: the largest k for which it is in the
+    // k-core, the largest subgraph in which every node has k neighbours or
+    // more.
+    const QVector<int>& coreNumbers();
+    // The largest of them, the graph's degeneracy.
+    int maxCore();
+    // Batagelj and Zaversnik's algorithm, O(m): the vertices are kept in
+    // buckets by degree and taken lowest first, each one lowering the
+    // degree of its neighbours in higher buckets.
+    static QVector<int> coreNumbersOf(const CompactGraph &graph);
+
+    // The number of nodes of each degree.
+    const QVector<int>& degreeHistogram() const;
+
+    qint64 triangles() const;
     double clusteringAvg();
     double clusteringCoeff(Node *node);
     double clusteringDegree(int degree);
+    double transitivity();
+    int componentCount();
+    // The number of nodes in the largest component.
+    int giantComponentSize();
+
+    // Counts the triangles of the whole graph; see TriangleCount.
+    static ClusteringStatistics clusteringStatisticsOf(const CompactGraph &graph);
+
+    // Estimates both clustering coefficients from the given number of
+    // random wedges each.  The error bound is Hoeffding's, so it only
+    // depends on the samples: 100000 give about 0.0043.
+    static ClusteringStatistics sampledClusteringStatisticsOf(const CompactGraph &graph,
+                                                              int samples = WEDGE_SAMPLES);
+
+    static const int WEDGE_SAMPLES = 100000;
     double powerLawExponent();
+    PowerLawFit powerLawFit();
+    // Scans every xmin with at least MIN_TAIL nodes from it up, in
+    // O(n + d^2) for a histogram of n nodes and d distinct degrees, with
+    // d^2 at most twice the edges.
+    static PowerLawFit powerLawFitOf(const QVector<int> &histogram);
+    static const int MIN_TAIL = 20;
     double shortestPath(Node *s,Node *d);
     //double smallWorldIndex();
 
+private slots:
+    void onNodeAdded(Node *node);
+    void onEdgeAdded(Node *source, Node *dest);
+    void onEdgeRemoved(Node *source, Node *dest);
+    void onCleared();
+
 private:
+    class PathLengths;
+    class SampledBatch;
+    class DependencySums;
+
+    // A result and the version of the graph it was computed for.
+    template <typename T>
+    class Cached {
+    public:
+        Cached() : version(0), valid(false) { }
+
+        bool isValidAt(quint64 current) const {
+            return valid && version == current;
+        }
+
+        void set(const T &newValue, quint64 at) {
+            value = newValue;
+            version = at;
+            valid = true;
+        }
+
+        T value;
+        quint64 version;
+        bool valid;
+    };
+
     GraphScene* graph;
 
-    double lengthSum(Node *s, QSet<Node*> &visited, QMap<Node*, int> &distance);
-    int intersectionCount(QVector<Node*> vec1, QVector<Node*> vec2);
+    Cached<CompactGraph> snapshot;
+    Cached<PathStatistics> paths;
+    Cached<DiameterStatistics> extremes;
+    Cached<CommunityStatistics> partition;
+    Cached<PowerLawFit> fit;
+    Cached<QVector<int> > cores;
+    // Kept when the graph changes, to start the next iteration from.
+    Cached<VertexScores> ranks;
+    Cached<VertexScores> eigenvector;
+
+    // Everything below is indexed by the order the nodes were added in.
+    QHash<Node*, int> index;
+    QVector<int> degrees;
+    QVector<int> nodeTriangles;
+    QVector<int> histogram;
+    qint64 degreeSum;
+    qint64 triangleSum;
+    // Paths of length two, the denominator of the transitivity.
+    qint64 wedgeSum;
+    double clusteringSum;
+
+    // Union-find over the nodes, by size.  Removing an edge may split a component,
+    // which union-find can't undo, so the components are then rebuilt the
+    // next time they are asked for.
+    QVector<int> parent;
+    // Only meaningful for the roots.
+    QVector<int> componentSizes;
+    int components;
+    int giantSize;
+    bool componentsStale;
+
+    static QVector<double> betweennessFrom(const CompactGraph &graph, const QVector<int> &sources,
+                                           double scale, StatisticsProgress *progress);
+
+    double localClustering(int v) const;
+    void changeVertex(int v, int degreeChange, int triangleChange);
+    int commonNeighbours(Node *source, Node *dest, int triangleChange);
+    int findComponent(int v);
+    void joinComponents(int u, int v);
+    void rebuildComponents();
 };
 
 #endif // STATISTICS_H
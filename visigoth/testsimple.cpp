@@ -4,6 +4,8 @@
 #include <QObject>
 #include <QSpinBox>
 #include <QString>
+#include <QThreadPool>
+#include <QtConcurrentRun>
 #include <QtTest/QtTest>
 #include <QTest>
 
@@ -11,8 +13,13 @@
 
 #include "algorithm.h"
 #include "barabasialbert.h"
+#include "compactgraph.h"
 #include "erdosrenyi.h"
+#include "exactforces.h"
+#include "fastmultipole.h"
 #include "graphscene.h"
+#include "node.h"
+#include "spatialgrid.h"
 #include "statistics.h"
 #include "wattsstrogatz.h"
 
@@ -81,6 +88,596 @@ private slots:
         QVERIFY(fpclassify(val) == FP_NORMAL && val > 0);
     }
 
+    void exactForces() {
+        QVector<VPointF> positions;
+        for (int i(0); i < 600; ++i) {
+            positions << VPointF((qrand() % 1000) - 500,
+                                 (qrand() % 600) - 300,
+                                 (qrand() % 600) - 300);
+        }
+
+        ExactForces exact(Node::REPULSION);
+        exact.build(positions);
+        exact.calculate();
+
+        // The tiled single precision kernel against a plain double sum
+        for (int i(0); i < positions.size(); ++i) {
+            VPointD error = VPointD(exact.force(i)) - exact.forceAt(VPointD(positions[i]), i);
+            QVERIFY(error.length() < 1e-3);
+        }
+    }
+
+    void gridAccuracy_data() {
+        QTest::addColumn<bool>("flat");
+        QTest::addColumn<double>("tolerance");
+
+        QTest::newRow("2d") << true << 0.02;
+        QTest::newRow("3d") << false << 0.05;
+    }
+
+    // The cutoff repulsion of a spread out graph, far wider than the cutoff,
+    // against the exact sum.  The tolerance is on the RMS error relative to
+    // the RMS force; about 1% and 3% are typical.
+    void gridAccuracy() {
+        QFETCH(bool, flat);
+        QFETCH(double, tolerance);
+
+        QVector<VPointF> positions;
+        for (int i(0); i < 2000; ++i) {
+            positions << VPointF(qrand() % 3000, qrand() % 3000, flat ? 0 : qrand() % 1500);
+        }
+
+        SpatialGrid grid(SpatialGrid::DEFAULT_CUTOFF, Node::REPULSION);
+        grid.build(positions);
+        ExactForces exact(Node::REPULSION);
+        exact.build(positions);
+
+        double error = 0.0;
+        double force = 0.0;
+        for (int i(0); i < positions.size(); ++i) {
+            VPointD expected = exact.forceAt(VPointD(positions[i]), i);
+            error += (VPointD(grid.force(i)) - expected).lengthSquared();
+            force += expected.lengthSquared();
+        }
+        QVERIFY(sqrt(error / force) < tolerance);
+    }
+
+    void treeAccuracy() {
+        scene->chooseAlgorithm("Barabasi Albert");
+        scene->setRepulsionMode(GraphScene::REPULSION_QUADTREE);
+        scene->setInstrumented(true);
+
+        // Opening every cell is exact
+        scene->setTolerance(0.0);
+        scene->calculateForces();
+        int exactInteractions = scene->layoutStats().interactions;
+        QVERIFY(scene->layoutStats().samples > 0);
+        QVERIFY(scene->layoutStats().maxError < 1e-4);
+
+        scene->setTolerance(QuadTree::TreeNode::tolerance);
+        scene->calculateForces();
+        QVERIFY(scene->layoutStats().interactions < exactInteractions);
+        QVERIFY(scene->layoutStats().rmsError <= scene->layoutStats().maxError);
+    }
+
+    void quadrupoleAccuracy() {
+        scene->chooseAlgorithm("Barabasi Albert");
+        scene->setRepulsionMode(GraphScene::REPULSION_QUADTREE);
+        scene->setInstrumented(true);
+
+        // Same cells opened, so the error can only be compared on the same
+        // positions: don't let the nodes move in between.
+        foreach (Node *node, scene->nodes()) {
+            node->setAllowAdvance(false);
+        }
+
+        scene->setQuadrupoles(false);
+        scene->setTolerance(QuadTree::TreeNode::tolerance);
+        qsrand(7);
+        scene->calculateForces();
+        GraphScene::LayoutStats monopole = scene->layoutStats();
+
+        scene->setQuadrupoles(true);
+        scene->setTolerance(QuadTree::TreeNode::tolerance);
+        qsrand(7);
+        scene->calculateForces();
+        GraphScene::LayoutStats quadrupole = scene->layoutStats();
+
+        QCOMPARE(quadrupole.interactions, monopole.interactions);
+        QVERIFY(quadrupole.rmsError < monopole.rmsError);
+    }
+
+    void frameBudget_data() {
+        QTest::addColumn<int>("mode");
+        QTest::addColumn<bool>("budgeted");
+
+        QTest::newRow("quadtree") << (int)GraphScene::REPULSION_QUADTREE << true;
+        QTest::newRow("grid") << (int)GraphScene::REPULSION_GRID << true;
+        QTest::newRow("exact") << (int)GraphScene::REPULSION_EXACT << true;
+        QTest::newRow("fmm") << (int)GraphScene::REPULSION_FMM << false;
+    }
+
+    void frameBudget() {
+        QFETCH(int, mode);
+        QFETCH(bool, budgeted);
+
+        // A path several times longer than the nodes moved between looks at
+        // the clock.
+        Node *last = scene->newNode();
+        last->setPos(VPointF(0.0), true);
+        for (int i(1); i < 500; ++i) {
+            Node *node = scene->newNode();
+            node->setPos(VPointF(qrand() % 1000, qrand() % 1000), true);
+            scene->newEdge(last, node);
+            last = node;
+        }
+        scene->setRepulsionMode((GraphScene::REPULSION_MODES)mode);
+        scene->setFrameBudget(1e-9);
+        QCOMPARE(scene->budgeted(), budgeted);
+
+        // Too short a budget for all the nodes, but the layout keeps going
+        // until it has gone over all of them.
+        qreal completed = 0.0;
+        while (budgeted && completed < 1.0) {
+            QVERIFY(scene->calculateForces());
+            QVERIFY(scene->layoutStats().completed > 0.0);
+            QVERIFY(scene->layoutStats().completed < 1.0);
+            completed += scene->layoutStats().completed;
+        }
+
+        scene->setFrameBudget(budgeted ? 0.0 : 1e-9);
+        scene->calculateForces();
+        QCOMPARE(scene->layoutStats().completed, 1.0);
+    }
+
+    void interpolation() {
+        Node *node = scene->newNode();
+        node->setPos(VPointF(0.0), true);
+        node->calculatePosition(VPointF(10.0, 0.0, 0.0));
+        QVERIFY(node->advance());
+
+        // Drawn between the last two steps
+        QVERIFY(node->displayPos(0.0) == VPointF(0.0));
+        QVERIFY(node->displayPos(0.5) == VPointF(5.0, 0.0, 0.0));
+        QVERIFY(node->displayPos(1.0) == node->pos());
+
+        // But put down at once
+        node->setPos(VPointF(20.0, 0.0, 0.0), true);
+        QVERIFY(node->displayPos(0.0) == node->pos());
+    }
+
+    void compactGraph() {
+        // A path of five, with one edge repeated backwards and a loop
+        QVector<CompactGraph::EdgePair> edges;
+        for (int i(1); i < 5; ++i) {
+            edges << CompactGraph::EdgePair(i - 1, i);
+        }
+        edges << CompactGraph::EdgePair(3, 2) << CompactGraph::EdgePair(4, 4);
+
+        CompactGraph graph(5, edges);
+        QCOMPARE(graph.edgeCount(), 4);
+        QCOMPARE(graph.degree(0), 1);
+        QCOMPARE(graph.degree(2), 2);
+
+        BreadthFirst bfs(graph);
+        QCOMPARE(bfs.distanceSum(0), (qint64) 10);
+        QCOMPARE(bfs.reached(), 5);
+        QCOMPARE(bfs.distance(4), 4);
+        QCOMPARE(bfs.distanceSum(2), (qint64) 6);
+
+        BitParallelSearch search(graph);
+        search.search(0, 5);
+        QCOMPARE(search.distanceSum(), (qint64) 40);
+        QCOMPARE(search.eccentricity(0), 4);
+        QCOMPARE(search.eccentricity(2), 2);
+        QCOMPARE(search.distanceCounts()[4], (qint64) 2);
+
+        // The same path through the scene
+        QVector<Node*> path;
+        for (int i(0); i < 5; ++i) {
+            path << scene->newNode();
+            if (i > 0) {
+                scene->newEdge(path[i - 1], path[i]);
+            }
+        }
+        QCOMPARE(scene->getStatistics()->lengthAvg(), 2.0);
+
+        QCOMPARE(scene->getStatistics()->diameter(), 4);
+
+        StatisticsProgress progress;
+        progress.cancel();
+        QCOMPARE(Statistics::pathStatisticsOf(CompactGraph(scene->nodes()), &progress).lengthAvg, 0.0);
+    }
+
+    void triangles() {
+        // A square with one diagonal: two triangles sharing 0 and 2
+        QVector<Node*> square;
+        for (int i(0); i < 4; ++i) {
+            square << scene->newNode();
+        }
+        for (int i(0); i < 4; ++i) {
+            scene->newEdge(square[i], square[(i + 1) % 4]);
+        }
+        scene->newEdge(square[0], square[2]);
+
+        CompactGraph graph(scene->nodes());
+        TriangleCount triangles(graph);
+        triangles.count();
+        QCOMPARE(triangles.triangles(), (qint64) 2);
+        QCOMPARE(triangles.triangles(0), (qint64) 2);
+        QCOMPARE(triangles.triangles(1), (qint64) 1);
+        QVERIFY(qFuzzyCompare(triangles.clustering(0), 2.0 / 3));
+        QVERIFY(qFuzzyCompare(triangles.clusteringAvg(), 5.0 / 6));
+        QVERIFY(qFuzzyCompare(triangles.transitivity(), 0.75));
+
+        Statistics *stats = scene->getStatistics();
+        QVERIFY(qFuzzyCompare(stats->clusteringCoeff(square[0]), 2.0 / 3));
+        QVERIFY(qFuzzyCompare(stats->clusteringCoeff(square[1]), 1.0));
+        QVERIFY(qFuzzyCompare(stats->clusteringAvg(), 5.0 / 6));
+    }
+
+    void incrementalStatistics() {
+        // Rewiring removes edges as well as adding them.
+        scene->chooseAlgorithm("Watts Strogatz");
+        Statistics *stats = scene->getStatistics();
+
+        Node *a = scene->edges()[0]->sourceNode();
+        Node *b = scene->edges()[0]->destNode();
+        scene->removeEdge(b, a);
+        QVERIFY(!scene->doesEdgeExist(a, b));
+
+        CompactGraph graph(scene->nodes());
+        Statistics::ClusteringStatistics exact = Statistics::clusteringStatisticsOf(graph);
+        QVERIFY(qFuzzyCompare(stats->degreeAvg(), 2.0 * graph.edgeCount() / graph.vertexCount()));
+        QVERIFY(qFuzzyCompare(1 + stats->clusteringAvg(), 1 + exact.clusteringAvg));
+        QVERIFY(qFuzzyCompare(1 + stats->transitivity(), 1 + exact.transitivity));
+        QVERIFY(stats->degreeHistogram()[a->edges().size()] > 0);
+
+        // A new node on its own is a component of its own.
+        int components = stats->componentCount();
+        Node *c = scene->newNode();
+        QCOMPARE(stats->componentCount(), components + 1);
+        scene->newEdge(a, c);
+        QCOMPARE(stats->componentCount(), components);
+    }
+
+    void components() {
+        // A path of three, an edge and a node on its own
+        QVector<Node*> nodes;
+        for (int i(0); i < 6; ++i) {
+            nodes << scene->newNode();
+        }
+        scene->newEdge(nodes[0], nodes[1]);
+        scene->newEdge(nodes[1], nodes[2]);
+        scene->newEdge(nodes[3], nodes[4]);
+
+        Statistics *stats = scene->getStatistics();
+        QCOMPARE(stats->componentCount(), 3);
+        QCOMPARE(stats->giantComponentSize(), 3);
+
+        Components components(CompactGraph(scene->nodes()));
+        QCOMPARE(components.count(), 3);
+        QCOMPARE(components.size(components.giant()), 3);
+        QCOMPARE(components.component(4), components.component(3));
+        QCOMPARE(components.connectedPairs(), (qint64) 8);
+
+        // Only the pairs with a path between them are averaged.
+        QCOMPARE(stats->lengthAvg(), 10.0 / 8);
+        QCOMPARE(stats->diameter(), 2);
+
+        scene->removeEdge(nodes[1], nodes[2]);
+        QCOMPARE(stats->componentCount(), 4);
+        QCOMPARE(stats->giantComponentSize(), 2);
+    }
+
+    void diameterBounds() {
+        // A path of seven with a triangle hanging off its middle, and a
+        // longer path apart from it
+        QVector<CompactGraph::EdgePair> edges;
+        for (int i(1); i < 7; ++i) {
+            edges << CompactGraph::EdgePair(i - 1, i);
+        }
+        edges << CompactGraph::EdgePair(3, 7) << CompactGraph::EdgePair(3, 8) << CompactGraph::EdgePair(7, 8);
+        for (int i(10); i < 14; ++i) {
+            edges << CompactGraph::EdgePair(i - 1, i);
+        }
+
+        CompactGraph graph(14, edges);
+        DiameterBounds bounds(graph);
+        while (!bounds.isExact()) {
+            bounds.refine();
+        }
+        QCOMPARE(bounds.diameter(), 6);
+        QCOMPARE(bounds.radius(), 3);
+        QVERIFY(bounds.searches() < 9);
+
+        Statistics::DiameterStatistics result = Statistics::diameterStatisticsOf(CompactGraph());
+        QCOMPARE(result.diameter, 0);
+        QCOMPARE(result.radius, 0);
+    }
+
+    void betweenness() {
+        // A path of five, next to a square
+        QVector<CompactGraph::EdgePair> edges;
+        for (int i(1); i < 5; ++i) {
+            edges << CompactGraph::EdgePair(i - 1, i);
+        }
+        edges << CompactGraph::EdgePair(5, 6) << CompactGraph::EdgePair(6, 7)
+              << CompactGraph::EdgePair(7, 8) << CompactGraph::EdgePair(8, 5);
+
+        CompactGraph graph(9, edges);
+        QVector<double> exact = Statistics::betweennessOf(graph);
+        QCOMPARE(exact.size(), 9);
+        QCOMPARE(exact[0], 0.0);
+        QCOMPARE(exact[1], 3.0);
+        QCOMPARE(exact[2], 4.0);
+        QCOMPARE(exact[3], 3.0);
+        for (int i(5); i < 9; ++i) {
+            QCOMPARE(exact[i], 0.5);
+        }
+
+        // With a source for every vertex there is nothing left to sample.
+        QVector<double> sampled = Statistics::sampledBetweennessOf(graph, 9);
+        for (int i(0); i < 9; ++i) {
+            QCOMPARE(sampled[i], exact[i]);
+        }
+    }
+
+    void vertexScores() {
+        // A star of three, and a node on its own
+        QVector<CompactGraph::EdgePair> edges;
+        edges << CompactGraph::EdgePair(0, 1) << CompactGraph::EdgePair(0, 2) << CompactGraph::EdgePair(0, 3);
+        CompactGraph graph(5, edges);
+
+        // The centre gets 0.85 of each leaf's rank, and every node 0.15 / 5
+        // plus 0.85 / 5 of the lone node's.
+        Statistics::VertexScores ranks = Statistics::pageRankOf(graph);
+        QVERIFY(ranks.converged);
+        double leaf = ranks.scores[1];
+        double jump = (0.15 + 0.85 * ranks.scores[4]) / 5;
+        QVERIFY(qAbs(ranks.scores[0] - (jump + 0.85 * 3 * leaf)) < 1e-5);
+        QVERIFY(qAbs(leaf - (jump + 0.85 * ranks.scores[0] / 3)) < 1e-5);
+        QVERIFY(qAbs(ranks.scores[4] - jump) < 1e-5);
+
+        // The eigenvalue is sqrt(3), with the centre sqrt(3) times a leaf.
+        Statistics::VertexScores eigenvector = Statistics::eigenvectorCentralityOf(graph);
+        QVERIFY(eigenvector.converged);
+        QVERIFY(qAbs(eigenvector.scores[0] - sqrt(3.0) / (sqrt(3.0) + 3)) < 1e-5);
+        QVERIFY(qAbs(eigenvector.scores[1] - 1 / (sqrt(3.0) + 3)) < 1e-5);
+        QVERIFY(eigenvector.scores[4] < 1e-5);
+
+        // Already there
+        QCOMPARE(Statistics::pageRankOf(graph, ranks.scores).iterations, 1);
+        QCOMPARE(Statistics::eigenvectorCentralityOf(graph, eigenvector.scores).iterations, 1);
+    }
+
+    void coreNumbers() {
+        // A square with both diagonals, a triangle hanging off one corner
+        // and a tail off that
+        QVector<Node*> nodes;
+        for (int i(0); i < 8; ++i) {
+            nodes << scene->newNode();
+        }
+        for (int i(0); i < 4; ++i) {
+            for (int j(i + 1); j < 4; ++j) {
+                scene->newEdge(nodes[i], nodes[j]);
+            }
+        }
+        scene->newEdge(nodes[3], nodes[4]);
+        scene->newEdge(nodes[3], nodes[5]);
+        scene->newEdge(nodes[4], nodes[5]);
+        scene->newEdge(nodes[5], nodes[6]);
+
+        Statistics *stats = scene->getStatistics();
+        int expected[] = { 3, 3, 3, 3, 2, 2, 1, 0 };
+        for (int i(0); i < 8; ++i) {
+            QCOMPARE(stats->coreNumbers()[i], expected[i]);
+        }
+        QCOMPARE(stats->maxCore(), 3);
+
+        scene->removeEdge(nodes[0], nodes[1]);
+        QCOMPARE(stats->maxCore(), 2);
+    }
+
+    void communities() {
+        // Two triangles joined by an edge, and a node on its own
+        QVector<CompactGraph::EdgePair> edges;
+        for (int i(0); i < 3; ++i) {
+            edges << CompactGraph::EdgePair(i, (i + 1) % 3);
+            edges << CompactGraph::EdgePair(3 + i, 3 + (i + 1) % 3);
+        }
+        edges << CompactGraph::EdgePair(2, 3);
+
+        Statistics::CommunityStatistics result = Statistics::communityStatisticsOf(CompactGraph(7, edges));
+        QCOMPARE(result.count, 3);
+        QCOMPARE(result.communities[1], result.communities[0]);
+        QCOMPARE(result.communities[2], result.communities[0]);
+        QCOMPARE(result.communities[4], result.communities[3]);
+        QVERIFY(result.communities[3] != result.communities[0]);
+        // 6 of the 7 edges inside, each triangle with half the degrees
+        QVERIFY(qAbs(result.modularity - (6.0 / 7 - 2 * 0.25)) < 1e-9);
+
+        QCOMPARE(Statistics::communityStatisticsOf(CompactGraph()).count, 0);
+    }
+
+    void powerLawFit() {
+        // Exactly k^-2.5, give or take the rounding
+        QVector<int> histogram(1001, 0);
+        for (int k(1); k <= 1000; ++k) {
+            histogram[k] = (int) floor(1e6 * pow(k, -2.5) + 0.5);
+        }
+        Statistics::PowerLawFit fit = Statistics::powerLawFitOf(histogram);
+        QVERIFY(qAbs(fit.exponent - 2.5) < 0.05);
+        QVERIFY(fit.distance < 0.01);
+        QVERIFY(fit.tailSize >= Statistics::MIN_TAIL);
+
+        // Too few nodes for any tail
+        QCOMPARE(Statistics::powerLawFitOf(QVector<int>(5, 1)).tailSize, 0);
+    }
+
+    void wedgeSampling() {
+        // Every wedge of a clique is closed, and none of a star's.
+        QVector<CompactGraph::EdgePair> clique;
+        QVector<CompactGraph::EdgePair> star;
+        for (int i(0); i < 20; ++i) {
+            for (int j(0); j < i; ++j) {
+                clique << CompactGraph::EdgePair(i, j);
+            }
+            if (i > 0) {
+                star << CompactGraph::EdgePair(0, i);
+            }
+        }
+
+        Statistics::ClusteringStatistics result =
+            Statistics::sampledClusteringStatisticsOf(CompactGraph(20, clique), 1000);
+        QVERIFY(!result.exact);
+        QVERIFY(result.error > 0.0 && result.error < 0.05);
+        QCOMPARE(result.clusteringAvg, 1.0);
+        QCOMPARE(result.transitivity, 1.0);
+
+        result = Statistics::sampledClusteringStatisticsOf(CompactGraph(20, star), 1000);
+        QCOMPARE(result.clusteringAvg, 0.0);
+        QCOMPARE(result.transitivity, 0.0);
+    }
+
+    void statisticsCache() {
+        Node *a = scene->newNode();
+        Node *b = scene->newNode();
+        Node *c = scene->newNode();
+        scene->newEdge(a, b);
+        Statistics *stats = scene->getStatistics();
+
+        QVERIFY(!stats->hasPathStatistics());
+        QCOMPARE(stats->lengthAvg(), 1.0);
+        QVERIFY(stats->hasPathStatistics());
+
+        // Only a change to the graph invalidates it.
+        quint64 version = scene->version();
+        QVERIFY(!scene->newEdge(b, a));
+        QCOMPARE(scene->version(), version);
+        QVERIFY(stats->hasPathStatistics());
+
+        scene->newEdge(b, c);
+        QVERIFY(scene->version() != version);
+        QVERIFY(!stats->hasPathStatistics());
+        QCOMPARE(stats->lengthAvg(), 8.0 / 6);
+
+        // Results for an old version are not kept.
+        Statistics::PathStatistics stale;
+        stale.lengthAvg = 7.0;
+        scene->removeEdge(b, c);
+        stats->cachePathStatistics(stale, version);
+        QVERIFY(!stats->hasPathStatistics());
+        QCOMPARE(stats->lengthAvg(), 1.0);
+    }
+
+    void statisticsJob() {
+        CompactGraph graph(5, QVector<CompactGraph::EdgePair>() << CompactGraph::EdgePair(0, 1));
+
+        StatisticsTask<Statistics::PathStatistics> *done = new StatisticsTask<Statistics::PathStatistics>();
+        StatisticsTask<Statistics::PathStatistics> *cancelled = new StatisticsTask<Statistics::PathStatistics>();
+        QSignalSpy doneSpy(done, SIGNAL(finished()));
+        QSignalSpy cancelledSpy(cancelled, SIGNAL(finished()));
+        done->setFuture(QtConcurrent::run(&Statistics::pathStatisticsOf, graph, done->progress()));
+        cancelled->setFuture(QtConcurrent::run(&Statistics::pathStatisticsOf, graph, cancelled->progress()));
+        cancelled->cancel();
+
+        // Both delete themselves, but only one reports back.
+        QThreadPool::globalInstance()->waitForDone();
+        QCoreApplication::processEvents();
+        QCOMPARE(doneSpy.count(), 1);
+        QCOMPARE(cancelledSpy.count(), 0);
+    }
+
+    void sampledPathLength() {
+        // Every vertex of a ring has the same distances, so any sample of
+        // them is exact.
+        const int n = 2100;
+        QVector<CompactGraph::EdgePair> edges;
+        for (int i(0); i < n; ++i) {
+            edges << CompactGraph::EdgePair(i, (i + 1) % n);
+        }
+
+        Statistics::PathStatistics result =
+            Statistics::sampledPathStatisticsOf(CompactGraph(n, edges), 0.01);
+        QVERIFY(!result.exact);
+        QVERIFY(qFuzzyCompare(result.lengthAvg, (n / 2.0) * (n / 2.0) / (n - 1)));
+        QVERIFY(result.lengthError < 1e-6);
+        QCOMPARE(result.diameter, n / 2);
+    }
+
+    void relaxAround() {
+        // A path, laid out in a line
+        QVector<Node*> path;
+        for (int i(0); i < 8; ++i) {
+            path << scene->newNode();
+            path[i]->setPos(VPointF(10.0 * i, 0.0, 0.0), true);
+            if (i > 0) {
+                scene->newEdge(path[i - 1], path[i]);
+            }
+        }
+
+        QVector<VPointF> before;
+        foreach (Node *node, path) {
+            before << node->pos();
+        }
+
+        scene->beginRelaxing(path[4], 1);
+        scene->relaxAround();
+        scene->endRelaxing();
+
+        for (int i(0); i < path.size(); ++i) {
+            bool moved = !(path[i]->pos() == before[i]);
+            QCOMPARE(moved, i == 3 || i == 5);
+        }
+    }
+
+    void relaxAroundFarField() {
+        Node *center = scene->newNode();
+        Node *moving = scene->newNode();
+        Node *further = scene->newNode();
+        center->setPos(VPointF(0.0, 0.0, 0.0), true);
+        moving->setPos(VPointF(10.0, 0.0, 0.0), true);
+        further->setPos(VPointF(20.0, 0.0, 0.0), true);
+        scene->newEdge(center, moving);
+        scene->newEdge(moving, further);
+
+        // Not in the neighbourhood, but right next to the moving node
+        Node *outside = scene->newNode();
+        outside->setPos(VPointF(10.0, 2.0, 0.0), true);
+
+        scene->beginRelaxing(center, 1);
+        scene->relaxAround();
+        scene->endRelaxing();
+        QVERIFY(moving->pos().y < 0.0);
+        QVERIFY(outside->pos() == VPointF(10.0, 2.0, 0.0));
+    }
+
+    void fastMultipole() {
+        scene->chooseAlgorithm("Barabasi Albert");
+
+        QuadTree quadTree(scene->graphCube().longestEdge());
+        foreach (Node *node, scene->nodes()) {
+            quadTree.addNode(node);
+        }
+        quadTree.computeQuadrupoles();
+
+        FastMultipole fmm(Node::REPULSION);
+        fmm.calculate(quadTree);
+        QCOMPARE(fmm.bodyCount(), scene->nodes().size());
+
+        QVector<VPointF> positions;
+        foreach (Node *node, scene->nodes()) {
+            positions << node->pos();
+        }
+        ExactForces exact(Node::REPULSION);
+        exact.build(positions);
+        for (int i(0); i < fmm.bodyCount(); ++i) {
+            VPointD truth = exact.forceAt(VPointD(fmm.body(i)->center()));
+            QVERIFY((VPointD(fmm.force(i)) - truth).length() <= 0.05 * truth.length() + 0.01);
+        }
+    }
+
     void hasControlWidget_data() {
         setAlgoNames();
     }
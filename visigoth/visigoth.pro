@@ -23,6 +23,10 @@ SOURCES += main.cpp \
            barabasialbert.cpp \
            statistics.cpp \
            quadtree.cpp \
+           spatialgrid.cpp \
+           exactforces.cpp \
+           compactgraph.cpp \
+           fastmultipole.cpp \
            erdosrenyi.cpp \
            wattsstrogatz.cpp \
            vtools.cpp \
@@ -37,6 +41,10 @@ HEADERS += mainwindow.h \
            algorithm.h \
            statistics.h \
            quadtree.h \
+           spatialgrid.h \
+           exactforces.h \
+           compactgraph.h \
+           fastmultipole.h \
            barabasialbert.h \
            erdosrenyi.h \
            wattsstrogatz.h \
@@ -50,6 +58,11 @@ FORMS += mainwindow.ui \
          statistics.ui \
          wattscontrol.ui
 
+*-g++* {
+    # Lets the compiler vectorise the force kernels at -O2
+    QMAKE_CXXFLAGS_RELEASE += -ftree-vectorize
+}
+
 test {
     CONFIG -= release
     TARGET = test
@@ -60,6 +73,13 @@ test {
     LIBS += -lgcov
 }
 
+bench {
+    TARGET = bench
+    QT += testlib
+    SOURCES -= main.cpp
+    SOURCES += benchmark.cpp
+}
+
 oauth {
     SOURCES += twitter.cpp
     HEADERS += twitter.h
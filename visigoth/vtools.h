@@ -1,31 +1,78 @@
 #ifndef VTOOLS_H
 #define VTOOLS_H
 
-#include <QtGlobal>     // For qreal
+#include <cmath>        // sqrt
 
-typedef qreal vreal;
+// Positions and forces are single precision: the layout doesn't need more,
+// and it halves the memory the layout and the renderer go through.
+typedef float vreal;
 
 
-class VPointF {
+/* A point or vector in space.  Everything is inline, and the operators are
+ * only found through their arguments, so scalars of other types convert to T
+ * instead of failing to deduce.
+ */
+template <typename T>
+class VPoint {
 public:
-    VPointF(vreal newX, vreal newY, vreal newZ);
-    VPointF(vreal newX, vreal newY);
-    VPointF(vreal newXYZ);
-
-    vreal x, y, z;
-
-    vreal lengthSquared();
-    vreal length();
-
-private:
-    friend VPointF operator + (const VPointF &p1, const VPointF &p2);
-    friend VPointF operator - (const VPointF &p1, const VPointF &p2);
-    friend VPointF operator * (const VPointF &p, const vreal scale);
-    friend VPointF operator * (const vreal scale, const VPointF &p);
-    friend VPointF operator / (const VPointF &p, const vreal scale);
-    friend bool operator == (const VPointF &p1, const VPointF &p2);
+    VPoint() :
+        x(0), y(0), z(0)
+    { }
+
+    VPoint(T newX, T newY, T newZ) :
+        x(newX), y(newY), z(newZ)
+    { }
+
+    VPoint(T newX, T newY) :
+        x(newX), y(newY), z(0)
+    { }
+
+    VPoint(T newXYZ) :
+        x(newXYZ), y(newXYZ), z(newXYZ)
+    { }
+
+    template <typename U>
+    explicit VPoint(const VPoint<U> &p) :
+        x(p.x), y(p.y), z(p.z)
+    { }
+
+    T x, y, z;
+
+    T lengthSquared() const {
+        return (x*x) + (y*y) + (z*z);
+    }
+
+    T length() const {
+        return std::sqrt(lengthSquared());
+    }
+
+    friend VPoint operator + (const VPoint &p1, const VPoint &p2) {
+        return VPoint(p1.x + p2.x, p1.y + p2.y, p1.z + p2.z);
+    }
+
+    friend VPoint operator - (const VPoint &p1, const VPoint &p2) {
+        return VPoint(p1.x - p2.x, p1.y - p2.y, p1.z - p2.z);
+    }
+
+    friend VPoint operator * (const VPoint &p, const T scale) {
+        return VPoint(p.x*scale, p.y*scale, p.z*scale);
+    }
+
+    friend VPoint operator * (const T scale, const VPoint &p) {
+        return (p * scale);
+    }
+
+    friend VPoint operator / (const VPoint &p, const T scale) {
+        return VPoint(p.x/scale, p.y/scale, p.z/scale);
+    }
+
+    friend bool operator == (const VPoint &p1, const VPoint &p2) {
+        return p1.x == p2.x && p1.y == p2.y && p1.z == p2.z;
+    }
 };
 
+typedef VPoint<vreal> VPointF;
+typedef VPoint<double> VPointD;
 
 
 class VCubeF {